@@ -17,8 +17,9 @@
 #include "helper.h"
 #include "MidiFile.h"
 
-MidiFile::MidiFile(const rsnd::SoundSequence *theAssocSeq)
+MidiFile::MidiFile(const rsnd::SoundSequence *theAssocSeq, uint32_t startOffset)
     : assocSeq(theAssocSeq),
+      startOffset(startOffset),
       globalTrack(this, false),
       globalTranspose(0),
       bMonophonicTracks(false) {
@@ -95,8 +96,9 @@ uint32_t ReadVarLen(const u8* data, uint32_t &offset) {
   return value;
 }
 
-rsnd::SeqArgType nextArgType = rsnd::SEQ_ARG_NONE;
-u32 nextArgOffset = 0;
+// per thread so sequences can be converted in parallel
+thread_local rsnd::SeqArgType nextArgType = rsnd::SEQ_ARG_NONE;
+thread_local u32 nextArgOffset = 0;
 
 uint32_t ReadArg(rsnd::SeqArgType defaultArgType, const u8* data, uint32_t &offset) {
   rsnd::SeqArgType argType = nextArgType == rsnd::SEQ_ARG_NONE ? defaultArgType : nextArgType;
@@ -159,7 +161,7 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
   u8 c = 0;
   const u8* trackData = static_cast<const u8*>(assocSeq->getSeqData());
   std::queue<TrackQueueElem> toProcessTracks;
-  toProcessTracks.push({ 0, 0, 0 });
+  toProcessTracks.push({ 0, 0, startOffset });
 
   while (!toProcessTracks.empty()) {
     TrackQueueElem toProcessTrack = toProcessTracks.front();
@@ -189,7 +191,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
         uint8_t vel = *rsnd::getOffsetT<const u8>(trackData, curOffset++);
         int dur = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
         t->AddNoteByDur(c, status_byte + transpose, vel, dur);
-        std::cout << "Note " << std::dec << (int)status_byte << ", " << (int)vel << ", " << (int)dur << '\n';
         if (noteWait) {
           t->AddDelta(dur);
         }
@@ -216,7 +217,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
         case rsnd::MML_WAIT:
         {
           int dur = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
-          std::cout << "rest " << std::dec << (int)dur << '\n';
           t->PurgePrevNoteOffs();
           t->AddDelta(dur);
           break;
@@ -224,7 +224,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
         case rsnd::MML_PRG:
         {
           u8 prog = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
-          std::cout << "Program change " << std::dec << (int)prog << '\n';
           t->AddProgramChange(c, prog);
           break;
         }
@@ -337,7 +336,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
           u32 destOffset = readbe24(trackData, curOffset);
           callStack.push({ curOffset, t->GetDelta(), 0 });
           curOffset = destOffset;
-          std::cout << "push curOffset " << curOffset << std::endl;
           break;
         }
         case rsnd::MML_RET:
@@ -348,7 +346,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
           }
           curOffset = callStack.top().retOffset;
           callStack.pop();
-          std::cout << "pop curOffset " << curOffset << std::endl;
           break;
         }
         case rsnd::MML_JUMP:
@@ -361,7 +358,6 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
           } else {
             processedJumps.insert(curOffset);
             curOffset = destOffset;
-            std::cout << "Jump curOffset " << curOffset << std::endl;
           }
           break;
         }
@@ -203,7 +203,8 @@ class MidiTrack {
 
 class MidiFile {
  public:
-  MidiFile(const rsnd::SoundSequence *assocSeq);
+  // startOffset is where the sequence's first track starts in the sequence data, for sounds sharing one RSEQ
+  MidiFile(const rsnd::SoundSequence *assocSeq, uint32_t startOffset = 0);
   ~MidiFile();
   MidiTrack *AddTrack();
   MidiTrack *InsertTrack(uint32_t trackNum);
@@ -220,6 +221,7 @@ class MidiFile {
 
  public:
   const rsnd::SoundSequence *assocSeq;
+  uint32_t startOffset;
   uint16_t ppqn;
 
   std::vector<MidiTrack *> aTracks;
@@ -31,11 +31,20 @@ void Chunk::SetData(const void *src, uint32_t datasize) {
 
 void Chunk::Write(uint8_t *buffer) {
   uint32_t padsize = GetPaddedSize(size) - size;
+  const uint32_t chunkSize = size + padsize;
   memcpy(buffer, id, 4);
-  *reinterpret_cast<uint32_t*>(buffer + 4) = size + padsize; // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
+  memcpy(buffer + 4, &chunkSize, 4); // chunks are only 2 byte aligned. Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
   memcpy(buffer + 8, data, GetPaddedSize(size));
 }
 
+void Chunk::Write(std::ostream &out) {
+  uint32_t paddedSize = GetPaddedSize(size);
+  out.write(id, 4);
+  out.write(reinterpret_cast<const char*>(&paddedSize), 4);
+  out.write(reinterpret_cast<const char*>(data), size);
+  if (paddedSize != size) out.put('\0');
+}
+
 Chunk *ListTypeChunk::AddChildChunk(Chunk *ck) {
   childChunks.push_back(ck);
   return ck;
@@ -60,7 +69,8 @@ void ListTypeChunk::Write(uint8_t *buffer) {
 
   uint32_t size = bufOffset;
   uint32_t padsize = GetPaddedSize(size) - size;
-  *reinterpret_cast<uint32_t*>(buffer + 4) = size + padsize - 8; // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
+  const uint32_t chunkSize = size + padsize - 8;
+  memcpy(buffer + 4, &chunkSize, 4); // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
 
   // Add pad byte
   if (padsize != 0) {
@@ -68,6 +78,21 @@ void ListTypeChunk::Write(uint8_t *buffer) {
   }
 }
 
+void ListTypeChunk::Write(std::ostream &out) {
+  // sizes are known up front, so the header goes out before the children
+  uint32_t size = GetSize() - 8;
+  out.write(this->id, 4);
+  out.write(reinterpret_cast<const char*>(&size), 4);
+  out.write(this->type, 4);
+
+  uint32_t childSize = 4;
+  for (auto iter = this->childChunks.begin(); iter != childChunks.end(); ++iter) {
+    (*iter)->Write(out);
+    childSize += (*iter)->GetSize();
+  }
+  if (childSize != size) out.put('\0');
+}
+
 RiffFile::RiffFile(const std::string& file_name, const std::string& form)
     : RIFFChunk(form),
       name(file_name) {
@@ -5,6 +5,7 @@
 #include <string>
 #include <cassert>
 #include <list>
+#include <ostream>
 #include <vector>
 #include "common.h"
 #include "helper.h"
@@ -34,6 +35,8 @@ class Chunk {
   void SetData(const void *src, uint32_t datasize);
   virtual uint32_t GetSize();    //  Returns the size of the chunk in bytes, including any pad byte.
   virtual void Write(uint8_t *buffer);
+  //  Same bytes as Write(buffer), streamed to out so the file never has to be assembled in memory
+  virtual void Write(std::ostream &out);
 
  protected:
   static inline uint32_t GetPaddedSize(uint32_t size) {
@@ -64,6 +67,7 @@ class ListTypeChunk: public Chunk {
   Chunk *AddChildChunk(Chunk *ck);
   uint32_t GetSize() override;    //  Returns the size of the chunk in bytes, including any pad byte.
   void Write(uint8_t *buffer) override;
+  void Write(std::ostream &out) override;
 };
 
 ////////////////////////////////////////////////////////////////////////////
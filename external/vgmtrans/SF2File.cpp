@@ -4,7 +4,10 @@
  * refer to the included LICENSE.txt file
  */
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include "version.h"
 #include "ScaleConversion.h"
 #include "SF2File.h"
@@ -129,7 +132,13 @@ SF2InfoListChunk::SF2InfoListChunk(const std::string& name)
     : LISTChunk("INFO") {
   // Create a date string
   time_t current_time = time(nullptr);
-  char *c_time_string = ctime(&current_time);
+  std::string c_time_string;
+  {
+    // ctime returns a buffer shared by all threads
+    static std::mutex ctimeMutex;
+    std::lock_guard<std::mutex> lock(ctimeMutex);
+    c_time_string = ctime(&current_time);
+  }
 
   // Add the child info chunks
   Chunk *ifilCk = new Chunk("ifil");
@@ -140,17 +149,102 @@ SF2InfoListChunk::SF2InfoListChunk(const std::string& name)
   AddChildChunk(ifilCk);
   AddChildChunk(new SF2StringChunk("isng", "EMU8000"));
   AddChildChunk(new SF2StringChunk("INAM", name));
-  AddChildChunk(new SF2StringChunk("ICRD", std::string(c_time_string)));
+  AddChildChunk(new SF2StringChunk("ICRD", c_time_string));
   AddChildChunk(new SF2StringChunk("ISFT", std::string("VGMTrans " + std::string(VGMTRANS_VERSION))));
 }
 
 
+SF2SampleChunk::SF2SampleChunk(const std::vector<WaveAudio>& waves)
+    : Chunk("smpl"), waves(waves) {
+  for (const WaveAudio& wav : waves) {
+    size += wav.dataLength + PADDING_BYTES;
+  }
+}
+
+void SF2SampleChunk::Write(uint8_t *buffer) {
+  memcpy(buffer, id, 4);
+  memcpy(buffer + 4, &size, 4);
+  uint8_t *out = buffer + 8;
+  for (const WaveAudio& wav : waves) {
+    memcpy(out, wav.data, wav.dataLength);
+    memset(out + wav.dataLength, 0, PADDING_BYTES);
+    out += wav.dataLength + PADDING_BYTES;
+  }
+}
+
+void SF2SampleChunk::Write(std::ostream &out) {
+  // the sizes are all even, so there is never a pad byte
+  static const char padding[PADDING_BYTES] = {};
+  out.write(id, 4);
+  out.write(reinterpret_cast<const char*>(&size), 4);
+  for (const WaveAudio& wav : waves) {
+    out.write(static_cast<const char*>(wav.data), wav.dataLength);
+    out.write(padding, PADDING_BYTES);
+  }
+}
+
 //  *******
 //  SF2File
 //  *******
 
+// every preset has a reverb and an instrument generator
+static constexpr size_t ITEMS_IN_PGEN = 2;
+
+// generators of an instrument zone, the velocity range is left out when velHi is 0
+static size_t zoneGenerators(const rsnd::SoundBank::InstrumentRegion& region) {
+  return region.velHi ? 12 : 11;
+}
+
+void SF2File::TableSizes::add(const std::vector<rsnd::SoundBank::InstrumentRegion>& regions) {
+  presets++;
+  zones += regions.size();
+  for (const auto& region : regions) generators += zoneGenerators(region);
+}
+
+void SF2File::TableSizes::add(const rsnd::SoundBank& bankfile) {
+  for (size_t i = 0; i < bankfile.getInstrCount(); i++) add(bankfile.getInstrRegions(i));
+}
+
+bool SF2File::TableSizes::fits() const {
+  // the terminal records index one past the last entry
+  return presets * ITEMS_IN_PGEN <= MAX_TABLE_INDEX && zones <= MAX_TABLE_INDEX && generators <= MAX_TABLE_INDEX;
+}
+
+static std::vector<SF2Bank> singleBank(const rsnd::SoundBank *bankfile, size_t waveCount) {
+  SF2Bank bank{bankfile, 0, "", std::vector<uint32_t>(waveCount)};
+  for (size_t i = 0; i < waveCount; i++) bank.sampleIds[i] = static_cast<uint32_t>(i);
+  return {bank};
+}
+
 SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>& waves)
-    : RiffFile("RSND bank", "sfbk") {
+    : SF2File("RSND bank", singleBank(bankfile, waves.size()), waves) {}
+
+SF2File::SF2File(const std::string& name, const std::vector<SF2Bank>& banks, const std::vector<WaveAudio>& waves)
+    : RiffFile(name, "sfbk") {
+  if (waves.size() > MAX_SAMPLES) {
+    std::cerr << "Error: " << waves.size() << " samples do not fit the 16 bit SF2 sample ids\n";
+    exit(-1);
+  }
+
+  // every instrument of every bank is one preset and one instrument, in bank order
+  struct Preset {
+    const SF2Bank *bank;
+    size_t instrIdx;
+    std::vector<rsnd::SoundBank::InstrumentRegion> regions;
+  };
+  std::vector<Preset> presets;
+  TableSizes tableSizes;
+  for (const SF2Bank& bank : banks) {
+    for (size_t i = 0; i < bank.bankfile->getInstrCount(); i++) {
+      presets.push_back({&bank, i, bank.bankfile->getInstrRegions(i)});
+      tableSizes.add(presets.back().regions);
+    }
+  }
+  if (!tableSizes.fits()) {
+    std::cerr << "Error: " << tableSizes.presets << " presets with " << tableSizes.zones << " zones and "
+              << tableSizes.generators << " generators do not fit the 16 bit SF2 table indices\n";
+    exit(-1);
+  }
 
   //***********
   // INFO chunk
@@ -159,26 +253,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
   // sdta chunk and its child smpl chunk containing all samples
   LISTChunk *sdtaCk = new LISTChunk("sdta");
-  Chunk *smplCk = new Chunk("smpl");
-
-  // Concatanate all of the samples together and add the result to the smpl chunk data
-  size_t numWaves = waves.size();
-  smplCk->size = 0;
-  for (size_t i = 0; i < numWaves; i++) {
-    const WaveAudio& wav = waves[i];
-    smplCk->size += wav.dataLength + (46 * 2);    // plus the 46 padding samples required by sf2 spec
-  }
-  smplCk->data = new uint8_t[smplCk->size];
-  uint32_t bufPtr = 0;
-  for (size_t i = 0; i < numWaves; i++) {
-    const WaveAudio& wav = waves[i];
-    size_t waveSz = wav.dataLength;
-
-    void* pcm = wav.data;
-    memcpy(smplCk->data + bufPtr, pcm, waveSz);
-    memset(smplCk->data + bufPtr + waveSz, 0, 46 * 2);
-    bufPtr += waveSz + (46 * 2);        // plus the 46 padding samples required by sf2 spec
-  }
+  Chunk *smplCk = new SF2SampleChunk(waves);
 
   sdtaCk->AddChildChunk(smplCk);
   this->AddChildChunk(sdtaCk);
@@ -193,31 +268,18 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   // phdr chunk
   //***********
   Chunk *phdrCk = new Chunk("phdr");
-  size_t numInstrs = bankfile->getInstrCount();
+  size_t numInstrs = presets.size();
   phdrCk->size = static_cast<uint32_t>((numInstrs + 1) * sizeof(sfPresetHeader));
   phdrCk->data = new uint8_t[phdrCk->size];
 
   for (size_t i = 0; i < numInstrs; i++) {
-    std::string instrName = "instr" + std::to_string(i);
-    int wPreset = i;
-    // I don't think these are known for RBNK files, so set to zero
-    int wBank = 0;
+    const Preset& preset = presets[i];
+    std::string instrName = preset.bank->namePrefix + "instr" + std::to_string(preset.instrIdx);
 
     sfPresetHeader presetHdr{};
     memcpy(presetHdr.achPresetName, instrName.c_str(), std::min(instrName.length(), static_cast<size_t>(20)));
-    presetHdr.wPreset = static_cast<uint16_t>(wPreset);
-
-    // Despite being a 16-bit value, SF2 only supports banks up to 127. Since
-    // it's pretty common to have either MSB or LSB be 0, we'll use whatever
-    // one is not zero, with preference for MSB.
-    //uint16_t bank16 = static_cast<uint16_t>(instr->ulBank);
-
-    if ((wBank & 0xFF00) == 0) {
-      presetHdr.wBank = wBank & 0x7F;
-    }
-    else {
-      presetHdr.wBank = (wBank >> 8) & 0x7F;
-    }
+    presetHdr.wPreset = static_cast<uint16_t>(preset.instrIdx);
+    presetHdr.wBank = preset.bank->bankNumber;
     presetHdr.wPresetBagNdx = static_cast<uint16_t>(i);
     presetHdr.dwLibrary = 0;
     presetHdr.dwGenre = 0;
@@ -235,7 +297,6 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   // pbag chunk
   //***********
   Chunk *pbagCk = new Chunk("pbag");
-  constexpr size_t ITEMS_IN_PGEN = 2;
   pbagCk->size = static_cast<uint32_t>((numInstrs + 1) * sizeof(sfPresetBag));
   pbagCk->data = new uint8_t[pbagCk->size];
   for (size_t i = 0; i < numInstrs; i++) {
@@ -302,22 +363,23 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   Chunk *instCk = new Chunk("inst");
   instCk->size = static_cast<uint32_t>((numInstrs + 1) * sizeof(sfInst));
   instCk->data = new uint8_t[instCk->size];
-  uint16_t rgnCounter = 0;
+  // counted in size_t, tableSizes checked that the 16 bit indices hold them
+  size_t rgnCounter = 0;
   for (size_t i = 0; i < numInstrs; i++) {
-    std::string instrName = "instr" + std::to_string(i);
-    auto regions = bankfile->getInstrRegions(i);
+    std::string instrName = presets[i].bank->namePrefix + "instr" + std::to_string(presets[i].instrIdx);
+    const auto& regions = presets[i].regions;
 
     sfInst inst{};
     memcpy(inst.achInstName, instrName.c_str(), std::min(instrName.length(), static_cast<size_t>(20)));
-    inst.wInstBagNdx = rgnCounter;
+    inst.wInstBagNdx = static_cast<uint16_t>(rgnCounter);
     rgnCounter += regions.size();
 
     memcpy(instCk->data + (i * sizeof(sfInst)), &inst, sizeof(sfInst));
   }
   //  add terminal sfInst
-  uint32_t numTotalRgns = rgnCounter;
+  const size_t numTotalRgns = rgnCounter;
   sfInst inst{};
-  inst.wInstBagNdx = numTotalRgns;
+  inst.wInstBagNdx = static_cast<uint16_t>(numTotalRgns);
   memcpy(instCk->data + (numInstrs * sizeof(sfInst)), &inst, sizeof(sfInst));
   pdtaCk->AddChildChunk(instCk);
 
@@ -327,19 +389,19 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   Chunk *ibagCk = new Chunk("ibag");
 
 
-  ibagCk->size = (numTotalRgns + 1) * sizeof(sfInstBag);
+  ibagCk->size = static_cast<uint32_t>((numTotalRgns + 1) * sizeof(sfInstBag));
   ibagCk->data = new uint8_t[ibagCk->size];
 
   rgnCounter = 0;
-  int instGenCounter = 0;
+  size_t instGenCounter = 0;
   for (size_t i = 0; i < numInstrs; i++) {
-    auto regions = bankfile->getInstrRegions(i);
+    const auto& regions = presets[i].regions;
 
     size_t numRgns = regions.size();
     for (size_t j = 0; j < numRgns; j++) {
       sfInstBag instBag{};
-      instBag.wInstGenNdx = instGenCounter;
-      instGenCounter += 12;
+      instBag.wInstGenNdx = static_cast<uint16_t>(instGenCounter);
+      instGenCounter += zoneGenerators(regions[j]);
       instBag.wInstModNdx = 0;
 
       memcpy(ibagCk->data + (rgnCounter++ * sizeof(sfInstBag)), &instBag, sizeof(sfInstBag));
@@ -347,7 +409,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   }
   //  add terminal sfInstBag
   sfInstBag instBag{};
-  instBag.wInstGenNdx = instGenCounter;
+  instBag.wInstGenNdx = static_cast<uint16_t>(instGenCounter);
   instBag.wInstModNdx = 0;
   memcpy(ibagCk->data + (rgnCounter * sizeof(sfInstBag)), &instBag, sizeof(sfInstBag));
   pdtaCk->AddChildChunk(ibagCk);
@@ -365,11 +427,12 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   // igen chunk
   //***********
   Chunk *igenCk = new Chunk("igen");
-  igenCk->size = (numTotalRgns * sizeof(sfInstGenList) * 12) + sizeof(sfInstGenList);
+  igenCk->size = static_cast<uint32_t>((instGenCounter + 1) * sizeof(sfInstGenList));
   igenCk->data = new uint8_t[igenCk->size];
   dataPtr = 0;
   for (size_t i = 0; i < numInstrs; i++) {
-    auto instrRegions = bankfile->getInstrRegions(i);
+    const auto& instrRegions = presets[i].regions;
+    const std::vector<uint32_t>& sampleIds = presets[i].bank->sampleIds;
 
     size_t numRgns = instrRegions.size();
     for (size_t j = 0; j < numRgns; j++) {
@@ -396,7 +459,8 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
       auto* instrInfo = instrRegion.instrInfo;
       EnvelopeParams envelope = envelopeFromInfo(instrInfo);
-      const WaveAudio& wav = waves[instrInfo->waveIdx];
+      const uint32_t sampleId = sampleIds[instrInfo->waveIdx];
+      const WaveAudio& wav = waves[sampleId];
 
       // initialAttenuation
       instGenList.sfGenOper = initialAttenuation;
@@ -467,7 +531,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
       // sampleID - this is the terminal chunk
       instGenList.sfGenOper = sampleID;
-      instGenList.genAmount.wAmount = static_cast<uint16_t>(instrInfo->waveIdx);
+      instGenList.genAmount.wAmount = static_cast<uint16_t>(sampleId);
       memcpy(igenCk->data + dataPtr, &instGenList, sizeof(sfInstGenList));
       dataPtr += sizeof(sfInstGenList);
 
@@ -492,6 +556,14 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   Chunk *shdrCk = new Chunk("shdr");
 
   size_t numSamps = waves.size();
+  // the first region using each sample provides its original key
+  std::vector<const rsnd::InstrInfo*> sampleInstrInfos(numSamps, nullptr);
+  for (const Preset& preset : presets) {
+    for (const auto& instrRegion : preset.regions) {
+      const rsnd::InstrInfo*& instrInfo = sampleInstrInfos[preset.bank->sampleIds[instrRegion.instrInfo->waveIdx]];
+      if (instrInfo == nullptr) instrInfo = instrRegion.instrInfo;
+    }
+  }
   shdrCk->size = static_cast<uint32_t>((numSamps + 1) * sizeof(sfSample));
   shdrCk->data = new uint8_t[shdrCk->size];
 
@@ -506,22 +578,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
     samp.dwEnd = samp.dwStart + (wav.dataLength / sizeof(uint16_t));
     sampOffset = samp.dwEnd + 46;        // plus the 46 padding samples required by sf2 spec
 
-    // Search through all regions for an associated sampInfo structure with this sample
-    rsnd::InstrInfo *instrInfo = nullptr;
-    for (size_t j = 0; j < numInstrs; j++) {
-      auto instrRegions = bankfile->getInstrRegions(j);
-
-      size_t numRgns = instrRegions.size();
-      for (size_t k = 0; k < numRgns; k++) {
-        auto instrRegion = instrRegions[k];
-        if (instrRegion.instrInfo->waveIdx == i) {
-          instrInfo = instrRegion.instrInfo;
-          break;
-        }
-      }
-      if (instrInfo != nullptr)
-        break;
-    }
+    const rsnd::InstrInfo *instrInfo = sampleInstrInfos[i];
     //  If we didn't find a rgn association, then idk.
     if (instrInfo == nullptr) {
       std::cout << "Warn: No instrument info for wave index " << i << '\n';
@@ -554,7 +611,20 @@ std::vector<uint8_t> SF2File::SaveToMem() {
 }
 
 bool SF2File::SaveSF2File(const std::filesystem::path &filepath) {
-  auto buf = SaveToMem();
-  rsnd::writeBinary(filepath, buf.data(), buf.size());
+  // streamed chunk by chunk, the samples go straight from the decoded waves to the file
+  std::ofstream file(filepath, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to create SF2 file: " << filepath << std::endl;
+    return false;
+  }
+  Write(file);
+  file.close();
+  if (!file) {
+    // e.g. a full disk, like WaveWriter don't leave a truncated SoundFont behind
+    std::cerr << "Failed to write SF2 file: " << filepath << std::endl;
+    std::error_code ec;
+    std::filesystem::remove(filepath, ec);
+    return false;
+  }
   return true;
 }
@@ -272,6 +272,21 @@ class SF2InfoListChunk: public LISTChunk {
   SF2InfoListChunk(const std::string& name);
 };
 
+//  smpl chunk that refers to the decoded waves instead of holding a copy of all of them.
+//  The waves must outlive the chunk
+class SF2SampleChunk: public Chunk {
+ public:
+  // the sf2 spec requires 46 zero samples after every sample
+  static constexpr uint32_t PADDING_BYTES = 46 * 2;
+
+  SF2SampleChunk(const std::vector<WaveAudio>& waves);
+  void Write(uint8_t *buffer) override;
+  void Write(std::ostream &out) override;
+
+ private:
+  const std::vector<WaveAudio>& waves;
+};
+
 class SF2sdtaChunk: public LISTChunk {
  public:
   SF2sdtaChunk();
@@ -279,9 +294,37 @@ class SF2sdtaChunk: public LISTChunk {
 
 class SynthFile;
 
+//  an RBNK's instruments in an SF2 file that may hold several banks.
+//  sampleIds maps the bank's wave indices to the file's samples
+struct SF2Bank {
+  const rsnd::SoundBank *bankfile;
+  // SF2 only has banks 0 to 127 (128 being percussion), some players reject higher numbers
+  uint16_t bankNumber;
+  std::string namePrefix;
+  std::vector<uint32_t> sampleIds;
+};
+
 class SF2File: public RiffFile {
  public:
+  // sampleID generators are 16 bit, callers have to split or refuse anything larger
+  static constexpr size_t MAX_SAMPLES = 0xffff;
+  // so are the indices into the preset, instrument zone and generator tables
+  static constexpr size_t MAX_TABLE_INDEX = 0xffff;
+
+  // entries the banks take in those tables, to check before decoding anything
+  struct TableSizes {
+    size_t presets = 0;
+    size_t zones = 0;
+    size_t generators = 0;
+
+    void add(const std::vector<rsnd::SoundBank::InstrumentRegion>& regions);
+    void add(const rsnd::SoundBank& bankfile);
+    bool fits() const;
+  };
+
+  // a single bank as bank 0, with its waves as the samples
   SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>& waves);
+  SF2File(const std::string& name, const std::vector<SF2Bank>& banks, const std::vector<WaveAudio>& waves);
   ~SF2File() override = default;
 
   std::vector<uint8_t> SaveToMem();
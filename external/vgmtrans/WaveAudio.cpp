@@ -2,39 +2,97 @@
 #include "WaveAudio.h"
 
 #include "rsnd/soundCommon.hpp"
+#include "common/threadPool.hpp"
 
 using namespace rsnd;
 
-std::vector<WaveAudio> toWaveCollection(const rsnd::SoundBank *bankfile, void* waveData) {
-  std::vector<WaveAudio> waveAudios;
+// samples of a wave's slice in the shared buffer. Slices start 32 byte aligned
+static size_t sliceSamples(const WaveAudio& wave) {
+  return (wave.dataLength / sizeof(s16) + 15) & ~static_cast<size_t>(15);
+}
 
-  for (int i = 0; i < bankfile->bankWave->waveInfos.size; i++) {
-    const WaveInfo* waveInfo = bankfile->getWaveInfo(i);
-    u32 channelCount = waveInfo->channelCount;
-      
-    u32 sampleBufferSize = channelCount * waveInfo->loopEnd * sizeof(s16);
-    s16* pcmBuffer = static_cast<s16*>(malloc(sampleBufferSize));
+// points every wave at its slice of the shared buffer, in wave order. The buffer comes from the wave
+// cache when it holds the collection already. Returns true when it still needs decoding
+static bool allocateCollection(WaveCollection& collection, const void* archive, const void* waveData) {
+  size_t total = 0;
+  std::vector<size_t> offsets(collection.waves.size());
+  for (size_t i = 0; i < collection.waves.size(); i++) {
+    offsets[i] = total;
+    total += sliceSamples(collection.waves[i]);
+  }
+  collection.pcm = getWaveCache().find(WaveCache::Key::make(archive, waveData, WaveCache::ALL_WAVES), total);
+  const bool decode = !collection.pcm;
+  if (decode) collection.pcm = WaveCache::Pcm(new s16[total], std::default_delete<s16[]>());
+  for (size_t i = 0; i < collection.waves.size(); i++) {
+    collection.waves[i].data = const_cast<s16*>(collection.pcm.get()) + offsets[i];
+    collection.waves[i].ownsData = false;
+  }
+  return decode;
+}
+
+// charged at the whole buffer, padding included
+static void cacheCollection(const WaveCollection& collection, const void* archive, const void* waveData) {
+  size_t total = 0;
+  for (const WaveAudio& wave : collection.waves) total += sliceSamples(wave);
+  getWaveCache().insert(WaveCache::Key::make(archive, waveData, WaveCache::ALL_WAVES), collection.pcm, total);
+}
 
-    for (int j = 0; j < waveInfo->channelCount; j++) {
-      const SoundWaveChannelInfo* chInfo = bankfile->getChannelInfo(waveInfo, j);
-      const AdpcParams* adpcParams = bankfile->getAdpcParams(waveInfo, chInfo);
+WaveCollection toWaveCollection(const rsnd::SoundBank *bankfile, const void* waveData, const void* archive) {
+  WaveCollection collection;
+  const u32 waveCount = bankfile->bankWave->waveInfos.size;
+  collection.waves.resize(waveCount);
+  for (u32 i = 0; i < waveCount; i++) {
+    const WaveInfo* waveInfo = bankfile->getWaveInfo(i);
+    WaveAudio& newWave = collection.waves[i];
+    newWave.dataLength = waveInfo->channelCount * waveInfo->getLoopEnd() * sizeof(s16);
+    newWave.sampleRate = waveInfo->getSampleRate();
+    newWave.loop = waveInfo->loop;
+    newWave.loopStart = waveInfo->getLoopStart();
+    newWave.loopEnd = waveInfo->getLoopEnd();
+  }
+  if (!allocateCollection(collection, archive, waveData)) return collection;
 
-      const u8* blockData = (const u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset;
+  // waves decode independently into their own slices
+  getThreadPool().parallelFor(waveCount, [&](size_t i) {
+    const WaveInfo* waveInfo = bankfile->getWaveInfo(i);
+    std::vector<ChannelData> channels = getWaveChannels(waveInfo, waveData);
+    decodeInterleaved(waveInfo->format, channels.data(), waveInfo->channelCount, waveInfo->getLoopEnd(),
+                      static_cast<s16*>(collection.waves[i].data), waveInfo->channelCount);
+  });
+  cacheCollection(collection, archive, waveData);
 
-      decodeBlock(blockData, waveInfo->loopEnd, pcmBuffer + j, channelCount, waveInfo->format, adpcParams);
-    }
+  return collection;
+}
 
-    waveAudios.emplace_back();
-    WaveAudio& newWave = waveAudios[waveAudios.size() - 1];
-    newWave.data = pcmBuffer;
-    newWave.dataLength = sampleBufferSize;
+WaveCollection toWaveCollection(const rsnd::SoundWaveArchive *waveArchive, const void* archive) {
+  WaveCollection collection;
+  const u32 waveCount = waveArchive->getWaveCount();
+  collection.waves.resize(waveCount);
+  for (u32 i = 0; i < waveCount; i++) {
+    size_t rwavSize;
+    const void* rwavData = waveArchive->getWaveFile(i, rwavSize);
+    SoundWave rwav(rwavData, rwavSize);
+    const WaveInfo* waveInfo = rwav.info;
+    WaveAudio& newWave = collection.waves[i];
+    newWave.dataLength = rwav.getTrackSampleBufferSize();
     newWave.sampleRate = waveInfo->getSampleRate();
     newWave.loop = waveInfo->loop;
-    newWave.loopStart = waveInfo->loopStart;
-    newWave.loopEnd = waveInfo->loopEnd;
+    newWave.loopStart = waveInfo->getLoopStart();
+    newWave.loopEnd = waveInfo->getLoopEnd();
   }
+  if (!allocateCollection(collection, archive, waveArchive->dataBase)) return collection;
+
+  getThreadPool().parallelFor(waveCount, [&](size_t i) {
+    size_t rwavSize;
+    const void* rwavData = waveArchive->getWaveFile(i, rwavSize);
+    SoundWave rwav(rwavData, rwavSize);
+    std::vector<ChannelData> channels = rwav.getChannels();
+    decodeInterleaved(rwav.info->format, channels.data(), channels.size(), rwav.getTrackSampleCount(),
+                      static_cast<s16*>(collection.waves[i].data), channels.size());
+  });
+  cacheCollection(collection, archive, waveArchive->dataBase);
 
-  return waveAudios;
+  return collection;
 }
 
 WaveAudio toWaveAudio(const rsnd::SoundWave *waveFile) {
@@ -49,8 +107,8 @@ WaveAudio toWaveAudio(const rsnd::SoundWave *waveFile) {
   waveAudio.dataLength = sampleBufferSize;
   waveAudio.sampleRate = waveInfo->getSampleRate();
   waveAudio.loop = waveInfo->loop;
-  waveAudio.loopStart = waveInfo->loopStart;
-  waveAudio.loopEnd = waveInfo->loopEnd;
+  waveAudio.loopStart = waveInfo->getLoopStart();
+  waveAudio.loopEnd = waveInfo->getLoopEnd();
 
   return waveAudio;
 }
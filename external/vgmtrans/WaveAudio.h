@@ -6,9 +6,12 @@
 #include <utility>
 #include <cstring>
 #include <iostream>
+#include <memory>
 
 #include "rsnd/SoundBank.hpp"
 #include "rsnd/SoundWave.hpp"
+#include "rsnd/SoundWaveArchive.hpp"
+#include "common/waveCache.hpp"
 
 struct WaveAudio {
   int sampleRate;
@@ -18,9 +21,11 @@ struct WaveAudio {
 
   void* data;
   int dataLength;
+  // false when data points into a WaveCollection's shared buffer
+  bool ownsData;
 
-  WaveAudio() : data(nullptr), dataLength(0) {}
-  WaveAudio(const WaveAudio& other) {
+  WaveAudio() : data(nullptr), dataLength(0), ownsData(true) {}
+  WaveAudio(const WaveAudio& other) : data(nullptr), ownsData(true) {
     if (other.data) {
       data = malloc(other.dataLength);
       memcpy(data, other.data, other.dataLength);
@@ -34,6 +39,7 @@ struct WaveAudio {
   WaveAudio(WaveAudio&& other) noexcept {
     data = nullptr;
     std::swap(data, other.data);
+    ownsData = other.ownsData;
     sampleRate = other.sampleRate;
     loop = other.loop;
     loopStart = other.loopStart;
@@ -45,6 +51,7 @@ struct WaveAudio {
       data = malloc(other.dataLength);
       memcpy(data, other.data, other.dataLength);
     }
+    ownsData = true;
     sampleRate = other.sampleRate;
     loop = other.loop;
     loopStart = other.loopStart;
@@ -53,12 +60,13 @@ struct WaveAudio {
     return *this;
   }
   WaveAudio& operator=(WaveAudio&& other) noexcept {
-    if (data) {
+    if (data && ownsData) {
       free(data);
       data = nullptr;
     }
     std::swap(data, other.data);
     data = other.data;
+    ownsData = other.ownsData;
     sampleRate = other.sampleRate;
     loop = other.loop;
     loopStart = other.loopStart;
@@ -66,8 +74,17 @@ struct WaveAudio {
     dataLength = other.dataLength;
     return *this;
   }
-  ~WaveAudio() { if (data) { free(data); data = nullptr; } }
+  ~WaveAudio() { if (data && ownsData) { free(data); data = nullptr; } }
 };
 
-std::vector<WaveAudio> toWaveCollection(const rsnd::SoundBank *bankfile, void* waveData);
+// decoded waves of one bank or archive, in wave index order, sharing one buffer. The buffer is the wave
+// cache's unit, so a collection is decoded once and released in one piece
+struct WaveCollection {
+  std::vector<WaveAudio> waves;
+  rsnd::WaveCache::Pcm pcm;
+};
+
+// archive is the file waveData/waveArchive lie in, it keys the wave cache
+WaveCollection toWaveCollection(const rsnd::SoundBank *bankfile, const void* waveData, const void* archive);
+WaveCollection toWaveCollection(const rsnd::SoundWaveArchive *waveArchive, const void* archive);
 WaveAudio toWaveAudio(const rsnd::SoundWave *waveFile);
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 enum ExtractionStyle {
   EXTRACT_GROUPS,
@@ -12,6 +13,10 @@ enum ExtractionStyle {
 struct RsarExtractOpts {
   ExtractionStyle extractStyle;
   bool extractRwars;
+  // one SoundFont for all banks instead of one per bank (--merged-sf2)
+  bool mergedSf2;
+  // sound names, globs or ids to extract (--only/--manifest). Empty extracts everything
+  std::vector<std::string> soundFilters;
 };
 
 struct ExtractOpts {
@@ -20,6 +25,13 @@ struct ExtractOpts {
   RsarExtractOpts rsarExtractOpts;
 };
 
+struct DecodeOpts {
+  // times the loop body of a looped BRSTM/BRWAV is played (--loops), 0 decodes one linear pass
+  unsigned loops;
+  // fade-out after the last loop in seconds (--fade)
+  double fadeSeconds;
+};
+
 struct ListOpts {
   bool sounds;
   bool groups;
@@ -30,8 +42,16 @@ struct CliOpts {
   std::filesystem::path inputFile;
   std::string subcommand;
   std::filesystem::path outputPath;
+  // worker threads (-j), 0 uses all hardware threads
+  unsigned jobs;
+  // decode kernel instruction set (--simd), empty picks the best one the CPU supports
+  std::string simd;
+  // budget of the decoded wave cache in MiB (--wave-cache), 0 disables it
+  unsigned waveCacheMiB;
   // specific to the extract subcommand
   ExtractOpts extractOpts;
+  // specific to the decode subcommand
+  DecodeOpts decodeOpts;
   // specific to the list subcommand
   ListOpts listOpts;
 };
\ No newline at end of file
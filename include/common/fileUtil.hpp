@@ -1,15 +1,85 @@
-
 #pragma once
 
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <vector>
 
 #include "types.h"
 
 namespace rsnd {
+/**
+ * Read-only view of an input file's contents.
+ * Regular files are memory mapped read-only; the format parsers only ever read through it.
+ * Pipes and other unmappable inputs fall back to a buffered read into heap memory.
+ */
+class MappedFile {
+private:
+  void* fileData;
+  size_t fileSize;
+  bool mapped;
+
+  void readBuffered(const std::filesystem::path& path);
+
+public:
+  MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const void* data() const { return fileData; }
+  size_t size() const { return fileSize; }
+  bool isMapped() const { return mapped; }
+};
+
 void* readBinary(const std::filesystem::path& path, size_t& size);
-void writeBinary(const std::filesystem::path& path, void* data, size_t size);
+void writeBinary(const std::filesystem::path& path, const void* data, size_t size);
+
+/**
+ * 16 bit PCM WAV file written piece by piece, so callers don't need the whole PCM in memory.
+ * Samples are gathered into a large buffer that is flushed at multiples of its size in the file.
+ * The sizes in the header are patched in when the writer is closed. Data past 4 GiB turns the
+ * file into RF64, for which room is reserved up front unless the expected length says it's not needed.
+ */
+class WaveWriter {
+private:
+  static const size_t BUFFER_SIZE = 1 << 20;
+
+  std::filesystem::path filepath;
+  std::ofstream file;
+  std::vector<char> buffer;
+  size_t bufferUsed;
+  u16 numChannels;
+  u64 numSamples;
+  bool rf64Reserved;
+
+  void writeHeader(u32 sampleRate);
+  void flush();
+  // reports a failed write and removes the incomplete file
+  void fail();
+
+public:
+  static const u64 UNKNOWN_LENGTH = ~0ull;
+  static const u32 RIFF_HEADER_SIZE = 44;
+  // "JUNK" chunk the size of a ds64 chunk, between the RIFF and fmt headers
+  static const u32 RF64_RESERVE_SIZE = 36;
+  // RF64 and ds64 headers, written over the RIFF header and the JUNK chunk on close
+  static const u32 RF64_HEADER_SIZE = 12 + RF64_RESERVE_SIZE;
+
+  // fills out[RF64_HEADER_SIZE] for a file with JUNK reserved up front
+  static void putRf64Header(char* out, u64 numSamples, u16 numChannels);
+
+  // expectedSamples is only a hint for the header layout, any number of samples can be written
+  WaveWriter(const std::filesystem::path& filepath, u32 sampleRate, u16 numChannels, u64 expectedSamples = UNKNOWN_LENGTH);
+  ~WaveWriter();
+  WaveWriter(const WaveWriter&) = delete;
+  WaveWriter& operator=(const WaveWriter&) = delete;
+
+  bool isOpen() const { return file.is_open(); }
+  // appends numSamples interleaved sample frames
+  void write(const s16* pcm, u64 numSamples);
+  void close();
+};
 
-void createWaveFile(const std::filesystem::path& filepath, void* pcm, int numSamples, int sampleRate, int numChannels);
-}
\ No newline at end of file
+void createWaveFile(const std::filesystem::path& filepath, const void* pcm, u64 numSamples, u32 sampleRate, u16 numChannels);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rsnd {
+/**
+ * Fixed size worker pool with one task deque per worker.
+ * Workers take their own newest task first and steal the oldest task of another worker when idle,
+ * so a few expensive tasks (e.g. SF2 builds) don't hold back the cheap ones queued behind them.
+ * The thread calling parallelFor also runs tasks until its batch is done, which makes nested calls safe.
+ */
+class ThreadPool {
+private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // one queue per worker, the last one is shared by threads outside the pool
+  std::vector<std::unique_ptr<TaskQueue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queuedTasks;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool stopping;
+
+  size_t ownQueue() const;
+  void push(size_t queueIdx, std::function<void()> task);
+  bool runOne(size_t queueIdx);
+  void workerLoop(size_t queueIdx);
+
+public:
+  // threadCount is the total parallelism including the calling thread, so 1 runs everything inline
+  explicit ThreadPool(unsigned threadCount);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned getThreadCount() const { return workers.size() + 1; }
+  // runs fn(0) .. fn(count - 1) across the pool and returns once all of them finished
+  void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  static unsigned defaultThreadCount();
+};
+
+// process wide pool, sized by setThreadCount before its first use (defaults to hardware threads)
+void setThreadCount(unsigned threadCount);
+ThreadPool& getThreadPool();
+}
@@ -1,45 +1,51 @@
-
 #pragma once
 
 #include <type_traits>
 #include <bit>
+#include <cstdint>
 
 #include "types.h"
 
 namespace rsnd {
+/**
+ * Big endian value as stored in the file. Converts to host order on load, so structs
+ * built from these can be cast directly onto the (read-only) file data without swapping it in place.
+ */
+template<typename T>
+struct be {
+  static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+  using Storage = std::conditional_t<sizeof(T) == 1, u8,
+                  std::conditional_t<sizeof(T) == 2, u16,
+                  std::conditional_t<sizeof(T) == 4, u32, u64>>>;
+
+  Storage raw;
+
+  T load() const {
+    Storage value = raw;
+    if constexpr (std::endian::native == std::endian::little && sizeof(T) > 1) value = std::byteswap(value);
+    return std::bit_cast<T>(value);
+  }
+  operator T() const { return load(); }
+};
+
 struct BinaryBlockHeader {
   char magic[4];
-  u32 length;
-
-  void bswap();
+  be<u32> length;
 };
 
 struct BinaryFileHeader {
   char magic[4];
-  u16 byteOrder;
-  u16 version;
-  u32 fileSize;
-  u16 headerSize;
-  u16 numBlocks;
-
-  void bswap();
+  be<u16> byteOrder;
+  be<u16> version;
+  be<u32> fileSize;
+  be<u16> headerSize;
+  be<u16> numBlocks;
 };
 
 template<typename T>
 struct Array {
-  u32 size;
+  be<u32> size;
   T elems[1];
-
-  void bswap() {
-    size = std::byteswap(size);
-    for (int i = 0; i < size; i++) {
-      if constexpr(std::is_integral_v<T>) {
-        elems[i] = std::byteswap(elems[i]);
-      } else {
-        elems[i].bswap();
-      }
-    }
-  }
 };
 
 enum RefType {
@@ -50,18 +56,17 @@ enum RefType {
 struct DataRef {
   u8 refType;
   u8 dataType;
-  u32 value;
+  be<u32> value;
 
-  void bswap();
-  void* getAddr(void* ptr) const {if (refType == 0) return reinterpret_cast<void*>(value); else return (u8*)ptr+value;}
+  const void* getAddr(const void* ptr) const {
+    if (refType == REFTYPE_ADDRESS) return reinterpret_cast<const void*>(static_cast<uintptr_t>(value.load()));
+    else return static_cast<const u8*>(ptr) + value;
+  }
   template<typename T>
-  T* getAddr(void* ptr) const {if (refType == 0) return reinterpret_cast<T*>(value); else return reinterpret_cast<T*>((u8*)ptr+value);}
+  const T* getAddr(const void* ptr) const { return static_cast<const T*>(getAddr(ptr)); }
 };
 
-inline void* getOffset(void* ptr, u32 offset) { return reinterpret_cast<u8*>(ptr) + offset; }
-template<typename T>
-inline T* getOffsetT(void* ptr, u32 offset) { return reinterpret_cast<T*>(reinterpret_cast<u8*>(ptr) + offset); }
+inline const void* getOffset(const void* ptr, u32 offset) { return reinterpret_cast<const u8*>(ptr) + offset; }
 template<typename T>
 inline const T* getOffsetT(const void* ptr, u32 offset) { return reinterpret_cast<const T*>(reinterpret_cast<const u8*>(ptr) + offset); }
 }
-f32 bswap_float(const float inFloat);
\ No newline at end of file
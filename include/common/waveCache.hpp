@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "types.h"
+
+namespace rsnd {
+/**
+ * Decoded PCM of archive waves, shared between everything extracted from one archive.
+ * Group items and banks often point at the same wave data, so a wave is decoded once and reused while
+ * it stays in the cache. Entries are evicted least recently used first once the budget is exceeded;
+ * evicted PCM stays alive for as long as a caller still holds it.
+ */
+class WaveCache {
+public:
+  // waveIdx of an entry holding every wave of the region in one buffer
+  static const u32 ALL_WAVES = ~0u;
+
+  // a wave of the wave data region at waveDataOffset inside archive (raw bank/RWSD data or an RWAR's data block),
+  // or all of them
+  struct Key {
+    const void* archive;
+    size_t waveDataOffset;
+    u32 waveIdx;
+
+    static Key make(const void* archive, const void* waveData, u32 waveIdx) {
+      return { archive, static_cast<size_t>(static_cast<const u8*>(waveData) - static_cast<const u8*>(archive)), waveIdx };
+    }
+    bool operator==(const Key& other) const = default;
+  };
+  // interleaved samples of one wave, or the waves of a region one after another
+  typedef std::shared_ptr<const s16> Pcm;
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  struct Entry {
+    Pcm pcm;
+    size_t sampleCount;
+    std::list<Key>::iterator lruPos;
+  };
+
+  std::mutex mutex;
+  // most recently used first
+  std::list<Key> lru;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+  size_t usedBytes;
+  size_t budgetBytes;
+
+  void evict();
+
+public:
+  explicit WaveCache(size_t budgetBytes);
+  WaveCache(const WaveCache&) = delete;
+  WaveCache& operator=(const WaveCache&) = delete;
+
+  // sampleCount counts every channel's samples. An entry of another length (the same wave read
+  // through different wave info) is a miss. Returns nullptr on a miss
+  Pcm find(const Key& key, size_t sampleCount);
+  void insert(const Key& key, Pcm pcm, size_t sampleCount);
+  // find, decoding the wave with decode into a new buffer and inserting it on a miss
+  Pcm get(const Key& key, size_t sampleCount, const std::function<void(s16*)>& decode);
+
+  // a budget of 0 disables the cache
+  void setBudget(size_t budgetBytes);
+  void clear();
+};
+
+// process wide cache, sized by setWaveCacheBudget (defaults to DEFAULT_WAVE_CACHE_BUDGET)
+static const size_t DEFAULT_WAVE_CACHE_BUDGET = 256 << 20;
+void setWaveCacheBudget(size_t budgetBytes);
+WaveCache& getWaveCache();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/soundCommon.hpp"
+
+namespace rsnd {
+/**
+ * Decoder history of an ADPCM wave every few frames, for waves stored as one large block (BRWAV, bank and
+ * WSD waves). With it any sample range can be decoded from the closest entry, and long waves decode in
+ * parallel pieces the way BRSTM blocks do. Building it takes one decode pass over the wave.
+ */
+class AdpcmSeekTable {
+private:
+  struct History {
+    s16 yn1;
+    s16 yn2;
+  };
+
+  u8 channelCount;
+  u32 sampleCount;
+  u32 entrySamples;
+  // history at the start of every entry, entry major
+  std::vector<History> history;
+
+public:
+  // 1024 frames, the sample count of a typical BRSTM block
+  static const u32 DEFAULT_INTERVAL_FRAMES = 1024;
+
+  AdpcmSeekTable(const ChannelData* channels, u8 channelCount, u32 sampleCount, u32 intervalFrames = DEFAULT_INTERVAL_FRAMES);
+
+  u8 getChannelCount() const { return channelCount; }
+  u32 getSampleCount() const { return sampleCount; }
+  u32 getEntrySamples() const { return entrySamples; }
+  u32 getEntryCount() const { return history.size() / channelCount; }
+  // the channel moved to the entry's first frame, with the history there
+  ChannelData getEntryChannel(const ChannelData& channel, u8 channelIdx, u32 entryIdx) const;
+
+  // decodes sampleCount samples per channel from startSample on, interleaved into buffer. channels are
+  // the ones the table was built from. Entries are spread over the thread pool. Returns the samples
+  // per channel written, less than asked for when the range runs past the end of the wave
+  u32 decodeRange(const ChannelData* channels, u32 startSample, u32 sampleCount, s16* buffer) const;
+};
+
+/**
+ * Seek tables of the waves of one bank or WSD, built on first use. Their samples live in wave data the
+ * caller hands in, so a table is kept per wave info and wave data pair.
+ */
+class AdpcmSeekTableCache {
+private:
+  mutable std::mutex mutex;
+  mutable std::map<std::pair<const WaveInfo*, const void*>, std::unique_ptr<const AdpcmSeekTable>> tables;
+
+public:
+  // nullptr for PCM waves
+  const AdpcmSeekTable* get(const WaveInfo* waveInfo, const void* waveData) const;
+  // like SoundWave::decodeRange, over the wave up to its loop end
+  u32 decodeRange(const WaveInfo* waveInfo, const void* waveData, u32 startSample, u32 sampleCount, s16* buffer) const;
+};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+
+#include "common/types.h"
+
+namespace rsnd {
+/**
+ * Pull renderer for a looped sound: the intro, the loop body loopCount times and a fade-out that keeps
+ * looping, the way the game plays it. The source is only read through range decodes, so memory stays
+ * at the caller's buffer no matter how many loops are rendered.
+ */
+class LoopRenderer {
+public:
+  // decodes sampleCount samples per channel from startSample on, interleaved. Returns the samples written
+  typedef std::function<u32(u32 startSample, u32 sampleCount, s16* buffer)> RangeDecoder;
+  // same, from loopOffset samples into a repeat of the loop body, which may start from the loop point
+  // decoder context instead of the linear history. Must not depend on how the body is split into calls
+  typedef std::function<u32(u32 loopOffset, u32 sampleCount, s16* buffer)> LoopDecoder;
+
+private:
+  RangeDecoder decodeRange;
+  LoopDecoder decodeLoop;
+  u8 channelCount;
+  u32 loopStart;
+  u32 loopEnd;
+  u64 sampleCount;
+  u64 fadeStart;
+  u64 position;
+
+  void applyFade(s16* buffer, u32 samples) const;
+
+public:
+  // a sound without a usable loop renders once, without fade
+  LoopRenderer(RangeDecoder decodeRange, LoopDecoder decodeLoop, u8 channelCount, u32 sourceSamples,
+               bool loop, u32 loopStart, u32 loopEnd, u32 loopCount, u32 fadeSamples);
+
+  u8 getChannelCount() const { return channelCount; }
+  // samples per channel of the whole render
+  u64 getSampleCount() const { return sampleCount; }
+  bool isDone() const { return position >= sampleCount; }
+
+  // renders up to maxSamples samples per channel into buffer. Returns the samples per channel written,
+  // 0 once the render is done
+  u32 read(s16* buffer, u32 maxSamples);
+};
+}
@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <string_view>
 
 #include "common/types.h"
 #include "common/util.h"
@@ -9,47 +11,39 @@
 namespace rsnd {
 // ==== RSAR ====
 struct SoundArchiveHeader : public BinaryFileHeader {
-  u32 symbBlockOffset;
-  u32 symbBlockSize;
-  u32 infoBlockOffset;
-  u32 infoBlockSize;
-  u32 fileBlockOffset;
-  u32 fileBlockSize;
-
-  void bswap();
+  be<u32> symbBlockOffset;
+  be<u32> symbBlockSize;
+  be<u32> infoBlockOffset;
+  be<u32> infoBlockSize;
+  be<u32> fileBlockOffset;
+  be<u32> fileBlockSize;
 };
 
 // ==== SYMB ====
 struct SymbHeader : public BinaryBlockHeader {
-  u32 nameTableOffset;
-  u32 soundTreeOffset;
-  u32 playerTreeOffset;
-  u32 groupTreeOffset;
-  u32 bankTreeOffset;
-
-  void bswap();
+  be<u32> nameTableOffset;
+  be<u32> soundTreeOffset;
+  be<u32> playerTreeOffset;
+  be<u32> groupTreeOffset;
+  be<u32> bankTreeOffset;
 };
 
 struct StringTreeNode {
   static const u16 FLAG_LEAF = ( 1 << 0 );
 
-  u16 flags;
-  u16 bit;
-  u32 leftIdx;
-  u32 rightIdx;
-  s32 strIdx;
-  s32 id;
-
-  void bswap();
+  be<u16> flags;
+  be<u16> bit;
+  be<u32> leftIdx;
+  be<u32> rightIdx;
+  be<s32> strIdx;
+  be<s32> id;
 };
 
-typedef Array<u32> StringTable;
+typedef Array<be<u32>> StringTable;
 
 struct StringTree {
-  u32 rootIdx;
+  be<u32> rootIdx;
   Array<StringTreeNode> nodes;
-
-  void bswap();
 };
 
 // ==== INFO ====
@@ -60,8 +54,6 @@ struct SoundArchiveInfo : public BinaryBlockHeader {
   DataRef fileTable;
   DataRef groupTable;
   DataRef soundCountTable;
-
-  void bswap();
 };
 
 // references to SoundInfoEntry
@@ -72,91 +64,77 @@ struct SoundInfoEntry {
   static const u8 TYPE_STRM = 2;
   static const u8 TYPE_WAVE = 3;
 
-  u32 fileNameIdx;
-  u32 fileIdx;
-  u32 playerId;
+  be<u32> fileNameIdx;
+  be<u32> fileIdx;
+  be<u32> playerId;
   DataRef sound3dParam;
   u8 volume;
   u8 playerPriority;
   u8 soundType;
   u8 remoteFilter;
   DataRef extendedInfoRef;
-  u32 _20;
-  u32 _24;
+  be<u32> _20;
+  be<u32> _24;
   u8 panMode;
   u8 panCurve;
   u8 actorPlayerId;
   u8 _2a;
-
-  void bswap();
 };
 
 struct SeqSoundInfo {
-  u32 offset;
-  u32 bankIdx;
-  u32 _8;
+  be<u32> offset;
+  be<u32> bankIdx;
+  be<u32> _8;
   u8 _c;
   u8 _d;
   u8 _e[2];
-  u32 _10;
-
-  void bswap();
+  be<u32> _10;
 };
 
 struct WsdSoundInfo {
-  u32 idx;
-  u32 _4;
+  be<u32> idx;
+  be<u32> _4;
   u8 _8;
   u8 _9;
   u8 _a[2];
-  u32 _c;
-
-  void bswap();
+  be<u32> _c;
 };
 
 struct StrmSoundInfo {
-  u32 startPos;
-  u16 _4;
-  u16 _6;
-  u32 _8;
-
-  void bswap();
+  be<u32> startPos;
+  be<u16> _4;
+  be<u16> _6;
+  be<u32> _8;
 };
 
 // Refs to BankInfo
 typedef Array<DataRef> BankTable;
 
 struct BankInfo {
-  u32 fileNameIdx;
-  u32 fileIdx;
-  u32 _c;
-
-  void bswap();
+  be<u32> fileNameIdx;
+  be<u32> fileIdx;
+  be<u32> _c;
 };
 
 // Refs to BankInfo
 typedef Array<DataRef> PlayerTable;
 
 struct PlayerInfo {
-  u32 fileNameIdx;
+  be<u32> fileNameIdx;
   u8 soundCount;
   u8 _5[3];
-  u32 _8;
-
-  void bswap();
+  be<u32> _8;
 };
 
 // Refs to FileInfo
 typedef Array<DataRef> FileTable;
 
 struct FileInfo {
-  u32 fileSize;
-  u32 waveDataSize;
-  s32 _8;
+  be<u32> fileSize;
+  be<u32> waveDataSize;
+  be<s32> _8;
   DataRef externalFileName;
   DataRef fileGroupInfo;
-
-  void bswap();
 };
 
 // array of groups the file belngs to. DataRef to FileGroup
@@ -164,11 +142,9 @@ typedef Array<DataRef> FileGroupInfo;
 
 struct FileGroup {
   // index of group
-  u32 groupIdx;
+  be<u32> groupIdx;
   // index of file in group
-  u32 idx;
-
-  void bswap();
+  be<u32> idx;
 };
 
 // Refs to GroupInfo
@@ -176,45 +152,39 @@ typedef Array<DataRef> GroupTable;
 
 struct GroupInfo {
   // -1 indicates anonymous group
-  s32 nameIdx;
-  u32 entryNum;
+  be<s32> nameIdx;
+  be<u32> entryNum;
   // null if embedded in archive
   DataRef externalFileName;
-  u32 fileOffset;
-  u32 fileSize;
-  u32 waveDataOffset;
-  u32 waveDataSize;
+  be<u32> fileOffset;
+  be<u32> fileSize;
+  be<u32> waveDataOffset;
+  be<u32> waveDataSize;
   DataRef groupItemTable;
-
-  void bswap();
 };
 
 // Refs to GroupItemInfo
 typedef Array<DataRef> GroupItemTable;
 
 struct GroupItemInfo {
-  u32 fileIdx;
-  u32 fileOffset;
-  u32 fileSize;
-  u32 waveDataOffset;
-  u32 waveDataSize;
-  u32 _14;
-
-  void bswap();
+  be<u32> fileIdx;
+  be<u32> fileOffset;
+  be<u32> fileSize;
+  be<u32> waveDataOffset;
+  be<u32> waveDataSize;
+  be<u32> _14;
 };
 
 struct SoundCountTable {
-  u16 seqSoundCount;
-  u16 seqTrackCount;
-  u16 strmSoundCount;
-  u16 strmTrackCount;
-  u16 strmChannelCount;
-  u16 waveSoundCount;
-  u16 waveTrackCount;
-  u16 _e;
-  u32 _10;
-
-  void bswap();
+  be<u16> seqSoundCount;
+  be<u16> seqTrackCount;
+  be<u16> strmSoundCount;
+  be<u16> strmTrackCount;
+  be<u16> strmChannelCount;
+  be<u16> waveSoundCount;
+  be<u16> waveTrackCount;
+  be<u16> _e;
+  be<u32> _10;
 };
 
 // ==== FILE ====
@@ -223,62 +193,110 @@ struct SoundArchiveFile : BinaryBlockHeader {
 
 class SoundArchive {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
+  // SYMB/INFO tables are resolved the first time an accessor needs them
+  mutable std::atomic<const StringTable*> stringTable{nullptr};
+  mutable std::atomic<const StringTree*> soundStringTree{nullptr};
+  mutable std::atomic<const StringTree*> playerStringTree{nullptr};
+  mutable std::atomic<const StringTree*> groupStringTree{nullptr};
+  mutable std::atomic<const StringTree*> bankStringTree{nullptr};
+
+  mutable std::atomic<const SoundTable*> soundTable{nullptr};
+  mutable std::atomic<const BankTable*> bankTable{nullptr};
+  mutable std::atomic<const PlayerTable*> playerTable{nullptr};
+  mutable std::atomic<const FileTable*> fileTable{nullptr};
+  mutable std::atomic<const GroupTable*> groupTable{nullptr};
+  mutable std::atomic<const SoundCountTable*> soundCountTable{nullptr};
+
+  mutable std::atomic<u32> parsedTableCount{0};
+
+  template<typename T, typename F>
+  const T* lazyTable(std::atomic<const T*>& table, F resolve) const {
+    const T* cached = table.load(std::memory_order_acquire);
+    if (cached) return cached;
+    const T* resolved = resolve();
+    if (table.compare_exchange_strong(cached, resolved, std::memory_order_acq_rel)) {
+      parsedTableCount++;
+      return resolved;
+    }
+    return cached;
+  }
+  s32 findId(const StringTree* tree, std::string_view name) const;
+
 public:
   // sections
-  SymbHeader* soundArchiveSymb;
-  SoundArchiveInfo* soundArchiveInfo;
-  SoundArchiveFile* soundArchiveFile;
+  const SymbHeader* soundArchiveSymb;
+  const SoundArchiveInfo* soundArchiveInfo;
+  const SoundArchiveFile* soundArchiveFile;
 
-  void* symbBase;
-  void* infoBase;
-  void* fileBase;
+  const void* symbBase;
+  const void* infoBase;
+  const void* fileBase;
 
-  // SYMB
-  StringTable* stringTable;
-  StringTree* soundStringTree;
-  StringTree* playerStringTree;
-  StringTree* groupStringTree;
-  StringTree* bankStringTree;
-
-  // INFO
-  SoundTable* soundTable;
-  BankTable* bankTable;
-  PlayerTable* playerTable;
-  FileTable* fileTable;
-  GroupTable* groupTable;
-  SoundCountTable* soundCountTable;
+  SoundArchive(const void* fileData, size_t fileSize);
+  SoundArchive(const SoundArchive&) = delete;
+  SoundArchive& operator=(const SoundArchive&) = delete;
 
-  SoundArchive(void* fileData, size_t fileSize);
+  const void* getData() const { return data; }
 
-  const char* getString(s32 idx) const { return idx > 0 ? static_cast<const char*>(getOffset(symbBase, stringTable->elems[idx])) : nullptr; }
-  const SoundInfoEntry* getSoundInfo(u32 idx) const { return static_cast<SoundInfoEntry*>(soundTable->elems[idx].getAddr(infoBase)); }
+  // SYMB
+  const StringTable* getStringTable() const;
+  const StringTree* getSoundStringTree() const;
+  const StringTree* getPlayerStringTree() const;
+  const StringTree* getGroupStringTree() const;
+  const StringTree* getBankStringTree() const;
 
-  const FileInfo* getFileInfo(u32 idx) const { return static_cast<FileInfo*>(fileTable->elems[idx].getAddr(infoBase)); }
-  const FileGroupInfo* getFileGroupInfo(u32 idx) const { return static_cast<FileGroupInfo*>(getFileInfo(idx)->fileGroupInfo.getAddr(infoBase)); }
+  // INFO
+  const SoundTable* getSoundTable() const;
+  const BankTable* getBankTable() const;
+  const PlayerTable* getPlayerTable() const;
+  const FileTable* getFileTable() const;
+  const GroupTable* getGroupTable() const;
+  const SoundCountTable* getSoundCountTable() const;
+
+  // number of SYMB/INFO tables resolved so far
+  u32 getParsedTableCount() const { return parsedTableCount; }
+
+  u32 getSoundCount() const { return getSoundTable()->size; }
+  u32 getBankCount() const { return getBankTable()->size; }
+  u32 getPlayerCount() const { return getPlayerTable()->size; }
+  u32 getFileCount() const { return getFileTable()->size; }
+  u32 getGroupCount() const { return getGroupTable()->size; }
+
+  // name -> id lookups through the SYMB string trees, -1 if there is no such name
+  s32 findSoundId(std::string_view name) const { return findId(getSoundStringTree(), name); }
+  s32 findPlayerId(std::string_view name) const { return findId(getPlayerStringTree(), name); }
+  s32 findGroupId(std::string_view name) const { return findId(getGroupStringTree(), name); }
+  s32 findBankId(std::string_view name) const { return findId(getBankStringTree(), name); }
+
+  const char* getString(s32 idx) const { return idx >= 0 ? static_cast<const char*>(getOffset(symbBase, getStringTable()->elems[idx])) : nullptr; }
+  const SoundInfoEntry* getSoundInfo(u32 idx) const { return getSoundTable()->elems[idx].getAddr<SoundInfoEntry>(infoBase); }
+
+  const FileInfo* getFileInfo(u32 idx) const { return getFileTable()->elems[idx].getAddr<FileInfo>(infoBase); }
+  const FileGroupInfo* getFileGroupInfo(u32 idx) const { return getFileInfo(idx)->fileGroupInfo.getAddr<FileGroupInfo>(infoBase); }
   const FileGroup* getFileGroup(u32 fileIdx, u32 fileGroupIdx) const;
   const char* getFileExternalPath(u32 idx) const { 
-    return static_cast<char*>(static_cast<FileInfo*>(fileTable->elems[idx].getAddr(infoBase))->externalFileName.getAddr(infoBase));
+    return getFileInfo(idx)->externalFileName.getAddr<char>(infoBase);
   }
   bool isFileExternal(u32 fileIdx) const { return getFileExternalPath(fileIdx) != nullptr; }
-  void* getInternalFileData(u32 fileIdx) const;
-  void* getInternalFileData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize=nullptr) const;
-  void* getInternalWaveData(u32 fileIdx) const;
-  void* getInternalWaveData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize=nullptr) const;
+  const void* getInternalFileData(u32 fileIdx, size_t* fileSize=nullptr) const;
+  const void* getInternalFileData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize=nullptr) const;
+  const void* getInternalWaveData(u32 fileIdx, size_t* fileSize=nullptr) const;
+  const void* getInternalWaveData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize=nullptr) const;
 
-  const GroupInfo* getGroupInfo(u32 idx) const { return static_cast<GroupInfo*>(groupTable->elems[idx].getAddr(infoBase)); }
+  const GroupInfo* getGroupInfo(u32 idx) const { return getGroupTable()->elems[idx].getAddr<GroupInfo>(infoBase); }
   int getGroupSize(const GroupInfo* groupInfo) const { return groupInfo->groupItemTable.getAddr<GroupItemTable>(infoBase)->size; }
   const GroupItemInfo* getGroupItemInfo(u32 groupIdx, u32 fileIdx) const {
-    return static_cast<GroupItemInfo*>(static_cast<GroupItemTable*>(getGroupInfo(groupIdx)->groupItemTable.getAddr(infoBase))->elems[fileIdx].getAddr(infoBase));
+    return getGroupInfo(groupIdx)->groupItemTable.getAddr<GroupItemTable>(infoBase)->elems[fileIdx].getAddr<GroupItemInfo>(infoBase);
   }
   const char* getGroupExternalPath(u32 groupIdx) const { 
-    return static_cast<char*>(getGroupInfo(groupIdx)->externalFileName.getAddr(infoBase));
+    return getGroupInfo(groupIdx)->externalFileName.getAddr<char>(infoBase);
   }
   bool isGroupExternal(u32 groupIdx) const { return getGroupExternalPath(groupIdx) != nullptr; }
 
-  const BankInfo* getBankInfo(u32 idx) const { return static_cast<BankInfo*>(bankTable->elems[idx].getAddr(infoBase)); }
+  const BankInfo* getBankInfo(u32 idx) const { return getBankTable()->elems[idx].getAddr<BankInfo>(infoBase); }
   
   const SeqSoundInfo* getSeqSoundInfo(const SoundInfoEntry* soundInfo) const { return soundInfo->extendedInfoRef.getAddr<SeqSoundInfo>(infoBase); }
   const WsdSoundInfo* getWsdSoundInfo(const SoundInfoEntry* soundInfo) const { return soundInfo->extendedInfoRef.getAddr<WsdSoundInfo>(infoBase); }
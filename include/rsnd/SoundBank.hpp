@@ -5,27 +5,28 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <filesystem>
+#include <span>
 #include <vector>
 
 #include "common/util.h"
 #include "rsnd/soundCommon.hpp"
+#include "rsnd/AdpcmSeekTable.hpp"
 #include "rsnd/SoundWave.hpp"
 
 namespace rsnd {
 struct SoundBankHeader : public BinaryFileHeader {
-  u32 dataOffset;
-  u32 dataLength;
+  be<u32> dataOffset;
+  be<u32> dataLength;
   // if non-zero, references to waves are within bank file, external RWAR otherwise
-  u32 waveOffset;
-  u32 waveLength;
-
-  void bswap();
+  be<u32> waveOffset;
+  be<u32> waveLength;
 };
 
 struct InstrInfo {
-  u32 waveIdx;
+  be<u32> waveIdx;
   s8 attack;
   s8 decay;
   s8 sustain;
@@ -38,13 +39,11 @@ struct InstrInfo {
   u8 volume;
   u8 pan;
   u8 surroundPan;
-  f32 pitch;
+  be<f32> pitch;
   DataRef lfoTable;
   DataRef graphEnvTable;
   DataRef randomizerTable;
-  u32 _res;
-
-  void bswap();
+  be<u32> _res;
 };
 
 enum RegionSet {
@@ -57,47 +56,61 @@ enum RegionSet {
 struct IndexRegion {
   u8 min;
   u8 max;
-  u16 _2;
+  be<u16> _2;
   // References to subregions
   DataRef regionRefs[1];
-
-  void bswap();
 };
 
 struct RangeTable {
   u8 rangeCount;
   u8 key[1];
-
-  void bswap() {}
 };
 
 struct SoundBankData : public BinaryBlockHeader {
   // defines key and velocity regions
   // reference to InstrInfo, RangeTable, or Index region
   Array<DataRef> instrs;
-
-  void bswap();
 };
 
 struct SoundBankWave : public BinaryBlockHeader {
   // references to WaveInfo
   Array<DataRef> waveInfos;
+};
 
-  void bswap();
+// a note to look up with SoundBank::resolve
+struct NoteQuery {
+  u32 program;
+  u8 key;
+  u8 velocity;
+  // set by resolve, nullptr when no region of the program covers the note
+  const InstrInfo* instrInfo;
 };
 
 class SoundBank {
 private:
   struct Subregion {
+    s16 low;
     s16 high;
     const DataRef* ref;
   };
 
-  void* data;
+  // every program's key/velocity regions flattened. The instrument of a note is
+  // zones[keyZones[program * 128 + key] * 128 + velocity]. Zone 0 has no instruments
+  struct RegionLookup {
+    std::vector<u32> keyZones;
+    std::vector<const InstrInfo*> zones;
+  };
+
+  const void* data;
   size_t dataSize;
 
-  void bswapRegionsRecurse(DataRef& regionRef);
+  // built by the first lookup
+  mutable std::atomic<const RegionLookup*> regionLookup{nullptr};
+  AdpcmSeekTableCache seekTables;
+
   std::vector<Subregion> getSubregions(const DataRef* ref) const;
+  const RegionLookup* getRegionLookup() const;
+  const RegionLookup* buildRegionLookup() const;
 
 public:
   struct InstrumentRegion {
@@ -106,31 +119,44 @@ public:
     s16 velLo;
     s16 velHi;
 
-    InstrInfo* instrInfo;
+    const InstrInfo* instrInfo;
   };
 
-  SoundBankData* bankData;
-  SoundBankWave* bankWave;
+  const SoundBankData* bankData;
+  const SoundBankWave* bankWave;
 
-  void* dataBase;
-  void* waveBase;
+  const void* dataBase;
+  const void* waveBase;
 
   bool containsWaves;
 
-  SoundBank(void* fileData, size_t fileSize, void* waveData=nullptr);
+  SoundBank(const void* fileData, size_t fileSize);
+  ~SoundBank();
+  SoundBank(const SoundBank&) = delete;
+  SoundBank& operator=(const SoundBank&) = delete;
 
-  DataRef* getSubregionRef(const DataRef* ref, int idx) const;
+  // nullptr when idx is outside the region set
+  const DataRef* getSubregionRef(const DataRef* ref, int idx) const;
   u32 getInstrCount() const { return bankData->instrs.size; }
-  InstrInfo* getInstrInfo(int progIdx, int key, int velocity);
+  const InstrInfo* getInstrInfo(int progIdx, int key, int velocity) const;
+  // getInstrInfo for many notes at once, without allocating
+  void resolve(std::span<NoteQuery> queries) const;
   std::vector<InstrumentRegion> getInstrRegions(int progIdx) const;
 
   const WaveInfo* getWaveInfo(int i) const { return bankWave->waveInfos.elems[i].getAddr<WaveInfo>(waveBase); }
   int getWaveInfoCount() const { return bankWave->waveInfos.size; }
   const SoundWaveChannelInfo* getChannelInfo(const WaveInfo* waveInfo, int i) const { 
-    const u32* channelInfoOffsets = getOffsetT<u32>(waveInfo, waveInfo->channelInfoTableOffset);
+    const be<u32>* channelInfoOffsets = getOffsetT<be<u32>>(waveInfo, waveInfo->channelInfoTableOffset);
     return getOffsetT<SoundWaveChannelInfo>(waveInfo, channelInfoOffsets[i]);
   }
   int getChannelCount(const WaveInfo* waveInfo) const { return waveInfo->channelCount; }
   const AdpcParams* getAdpcParams(const WaveInfo* waveInfo, const SoundWaveChannelInfo* chInfo) const { return getOffsetT<AdpcParams>(waveInfo, chInfo->adpcmOffset); }
+  // seek table of wave i in waveData, built by the first call. nullptr for PCM waves
+  const AdpcmSeekTable* getWaveSeekTable(int i, const void* waveData) const { return seekTables.get(getWaveInfo(i), waveData); }
+  // decodes sampleCount samples per channel of wave i from startSample on, interleaved into buffer.
+  // Returns the samples per channel written
+  u32 decodeWaveRange(int i, const void* waveData, u32 startSample, u32 sampleCount, s16* buffer) const {
+    return seekTables.decodeRange(getWaveInfo(i), waveData, startSample, sampleCount, buffer);
+  }
 };
 }
\ No newline at end of file
@@ -117,48 +117,41 @@ enum SeqArgType {
 };
 
 struct SoundSequenceHeader : public BinaryFileHeader {
-  u32 dataOffset;
-  u32 dataLength;
-  u32 lablOffset;
-  u32 lablLength;
-
-  void bswap();
+  be<u32> dataOffset;
+  be<u32> dataLength;
+  be<u32> lablOffset;
+  be<u32> lablLength;
 };
 
 struct SoundSequenceData : public BinaryBlockHeader {
-  u32 offset;
-
-  void bswap();
+  be<u32> offset;
 };
 
 struct SoundSequenceLabel : public BinaryBlockHeader {
-  Array<u32> labelOffs;
-
-  void bswap();
+  Array<be<u32>> labelOffs;
 };
 
 struct SeqLabel {
-  u32 dataOffset;
-  u32 nameLength;
+  be<u32> dataOffset;
+  be<u32> nameLength;
   char name[1];
 
-  void bswap();
   std::string nameStr() const;
 };
 
 class SoundSequence {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
 public:
-  SoundSequenceData* seqData;
-  SoundSequenceLabel* label;
+  const SoundSequenceData* seqData;
+  const SoundSequenceLabel* label;
 
-  void* dataBase;
-  void* labelBase;
+  const void* dataBase;
+  const void* labelBase;
 
-  SoundSequence(void* fileData, size_t fileSize);
+  SoundSequence(const void* fileData, size_t fileSize);
 
   const SeqLabel* getSeqLabel(u32 i) const { return getOffsetT<SeqLabel>(labelBase, label->labelOffs.elems[i]); }
   const void* getSeqData() const { return getOffsetT<const void>(dataBase, 0); }
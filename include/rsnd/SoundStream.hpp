@@ -1,7 +1,10 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <filesystem>
+#include <vector>
 
 #include "common/types.h"
 #include "common/util.h"
@@ -10,42 +13,32 @@
 
 namespace rsnd {
 struct SoundStreamHeader : BinaryFileHeader {
-  u32 headOffset;
-  u32 headSize;
-  u32 adpcOffset;
-  u32 adpcSize;
-  u32 dataOffset;
-  u32 dataSize;
-
-  void bswap();
+  be<u32> headOffset;
+  be<u32> headSize;
+  be<u32> adpcOffset;
+  be<u32> adpcSize;
+  be<u32> dataOffset;
+  be<u32> dataSize;
 };
 
 struct SoundStreamHead : public BinaryBlockHeader {
   DataRef streamDataInfo;
   DataRef trackTable;
   DataRef channelTable;
-
-  void bswap();
 };
 
 struct AdpcEntry {
-  s16 yn1;
-  s16 yn2;
-
-  void bswap();
+  be<s16> yn1;
+  be<s16> yn2;
 };
 
 struct SoundStreamAdpc : public BinaryBlockHeader {
   // one for each block and each channel
   AdpcEntry adpcEntries[1];
-
-  void bswap();
 };
 
 struct SoundStreamData : public BinaryBlockHeader {
-  u32 dataOffset;
-
-  void bswap();
+  be<u32> dataOffset;
 };
 
 struct StreamDataInfo {
@@ -57,21 +50,20 @@ struct StreamDataInfo {
   u8 loop;
   u8 channelCount;
   u8 sampleRate24;
-  u16 sampleRate;
-  u16 blockHeaderOffset;
-  u32 loopStart;
-  u32 loopEnd;
-  u32 dataOffset;
-  u32 blockCount;
-  u32 blockSize;
-  u32 blockSamples;
-  u32 finalBlockSize;
-  u32 finalBlockSamples;
-  u32 finalBlockPaddedSize;
-  u32 adpcmInterval;
-  u32 adpcmDataSize;
+  be<u16> sampleRate;
+  be<u16> blockHeaderOffset;
+  be<u32> loopStart;
+  be<u32> loopEnd;
+  be<u32> dataOffset;
+  be<u32> blockCount;
+  be<u32> blockSize;
+  be<u32> blockSamples;
+  be<u32> finalBlockSize;
+  be<u32> finalBlockSamples;
+  be<u32> finalBlockPaddedSize;
+  be<u32> adpcmInterval;
+  be<u32> adpcmDataSize;
 
-  void bswap();
   u32 getSampleRate() const { return (sampleRate24 << 16) + sampleRate; }
 };
 
@@ -82,60 +74,58 @@ struct TrackTable {
   u8 trackCount;
   u8 trackInfoType;
   DataRef trackInfo[1];
-
-  void bswap();
 };
 
 struct TrackInfoSimple {
   u8 channelCount;
   u8 channelIndices[1];
-
-  void bswap(){}
 };
 
 struct TrackInfoExtended {
   u8 volume;
   u8 pan;
-  u16 _unk2;
-  u32 _unk4;
+  be<u16> _unk2;
+  be<u32> _unk4;
   u8 channelCount;
   u8 channelIndices[1];
-
-  void bswap(){}
 };
 
 struct ChannelTable {
   u8 channelCount;
   u8 padding[3];
   DataRef channelInfo[1];
-
-  void bswap();
 };
 
 struct ChannelInfo {
   DataRef adpcParams;
-
-  void bswap();
 };
 
 class SoundStream {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
-  void decodeChannelPcm8(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
-  void decodeChannelPcm16(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
-  void decodeChannelAdpcm(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  // native copies of the StreamDataInfo fields the decoders use
+  u8 format;
+  u8 streamChannelCount;
+  u32 blockCount;
+  u32 blockSamples;
+  u32 finalBlockSamples;
+  // data and starting history of every (block, channel) pair, block major. Built by the constructor
+  std::vector<ChannelData> blockTable;
+
+  ChannelData getBlockChannel(u8 channelIdx, u32 blockIdx) const { return blockTable[static_cast<size_t>(blockIdx) * streamChannelCount + channelIdx]; }
+  void decodeBlockRange(u32 blockIdx, const u8* channelIndices, u8 channelCount, u32 firstSample, u32 sampleCount, s16* buffer) const;
 public:
-  SoundStreamHead* strmHead;
-  SoundStreamData* strmData;
-  SoundStreamAdpc* strmAdpc;
+  const SoundStreamHead* strmHead;
+  const SoundStreamData* strmData;
+  const SoundStreamAdpc* strmAdpc;
 
-  StreamDataInfo* strmDataInfo;
-  TrackTable* trackTable;
-  ChannelTable* channelTable;
+  const StreamDataInfo* strmDataInfo;
+  const TrackTable* trackTable;
+  const ChannelTable* channelTable;
 
-  SoundStream(void* fileData, size_t fileSize);
+  SoundStream(const void* fileData, size_t fileSize);
   const ChannelInfo* getChannelInfo(u8 channelIdx) const;
   const u8 getTrackInfoType() const { return trackTable->trackInfoType; };
   const TrackInfoExtended* getTrackInfoExtended(u8 trackIdx) const;
@@ -144,8 +134,33 @@ public:
   const AdpcEntry* getAdpcEntry(u32 b, u8 c) const;
   const u32 getBlockSize(u32 b) const { return b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockSize : strmDataInfo->blockSize; }
   const u32 getSampleCount() const;
+  u32 getBlockCount() const { return blockCount; }
+  // samples per channel of every block but the last one
+  u32 getFullBlockSamples() const { return blockSamples; }
+  u32 getBlockSamples(u32 b) const { return b + 1 == blockCount ? finalBlockSamples : blockSamples; }
+  // channel indices of a track, exits on an invalid track info type
+  const u8* getTrackChannels(u8 trackIdx, u8& channelCount) const;
+  // warns and returns false for formats that can't be decoded
+  bool checkFormat() const;
   const u8* getBlockData(u8 channelIdx, u32 blockIdx) const;
+  void decodeBlock(u8 channelIdx, u32 blockIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
   void decodeChannel(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  // decodes one block of the given channels interleaved into buffer, which points at the block's first sample
+  void decodeBlockChannels(u32 blockIdx, const u8* channelIndices, u8 channelCount, s16* buffer) const;
+  // decodes the given channels interleaved into buffer, spread over the thread pool
+  void decodeChannels(const u8* channelIndices, u8 channelCount, s16* buffer) const;
+  // decodes sampleCount samples per channel of a track from startSample on, interleaved into buffer.
+  // Only the blocks covering the range are touched. Returns the samples per channel written,
+  // less than asked for when the range runs past the end of the stream
+  u32 decodeRange(u8 trackIdx, u32 startSample, u32 sampleCount, s16* buffer) const;
+  // decodeRange from loopOffset samples into a repeat of the loop body. An ADPCM loop starting on a
+  // frame boundary decodes the rest of the loop block from the loop point context (AdpcmParamLoop),
+  // like the hardware does when it jumps back. Other loops use the linear history
+  u32 decodeLoopRange(u8 trackIdx, u32 loopOffset, u32 sampleCount, s16* buffer) const;
+  bool isLooped() const { return strmDataInfo->loop != 0; }
+  u32 getLoopStart() const { return strmDataInfo->loopStart; }
+  // first sample past the loop, the end of the stream unless the header says otherwise
+  u32 getLoopEnd() const { return std::min<u32>(strmDataInfo->loopEnd, getSampleCount()); }
   s16* getChannelPcm(u8 channelIdx) const;
   s16* getTrackPcm(u8 trackIdx, u8& channelCount) const;
   void trackToWaveFile(u8 trackIdx, std::filesystem::path wavePath) const;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common/types.h"
+#include "rsnd/SoundStream.hpp"
+
+namespace rsnd {
+/**
+ * Pull decoder for one track of a stream.
+ * Each read decodes the next whole blocks interleaved into a buffer the caller owns and reuses,
+ * so memory stays at a few blocks no matter how long the stream is.
+ */
+class SoundStreamReader {
+private:
+  const SoundStream& stream;
+  const u8* channelIndices;
+  u8 channelCount;
+  u32 nextBlock;
+
+public:
+  SoundStreamReader(const SoundStream& stream, u8 trackIdx);
+
+  u8 getChannelCount() const { return channelCount; }
+  u32 getSampleRate() const { return stream.strmDataInfo->getSampleRate(); }
+  // samples per channel of the whole track
+  u32 getSampleCount() const { return stream.getSampleCount(); }
+  // samples per channel of a full block, read needs room for at least one
+  u32 getBlockSamples() const { return stream.getFullBlockSamples(); }
+  bool isDone() const { return nextBlock >= stream.getBlockCount(); }
+  void rewind() { nextBlock = 0; }
+
+  // decodes as many whole blocks as fit in maxSamples samples per channel into buffer, spread over
+  // the thread pool. Returns the samples per channel written, 0 once the track is done.
+  // maxSamples below getBlockSamples() is a caller bug: asserts, or warns and returns 0 in release builds
+  u32 read(s16* buffer, u32 maxSamples);
+};
+}
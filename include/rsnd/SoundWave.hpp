@@ -3,64 +3,84 @@
 
 #include <cstddef>
 #include <filesystem>
+#include <atomic>
+#include <vector>
 
 #include "common/util.h"
 #include "rsnd/soundCommon.hpp"
+#include "rsnd/AdpcmSeekTable.hpp"
 
 namespace rsnd {
 struct SoundWaveHeader : public BinaryFileHeader {
-  u32 infoOffset;
-  u32 infoLength;
-  u32 dataOffset;
-  u32 dataLength;
-
-  void bswap();
+  be<u32> infoOffset;
+  be<u32> infoLength;
+  be<u32> dataOffset;
+  be<u32> dataLength;
 };
 
 struct SoundWaveInfo : public BinaryBlockHeader, public WaveInfo {
-  void bswap();
 };
 
 typedef BinaryBlockHeader SoundWaveData;
 
 class SoundWave {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
+  // built on first use, see getSeekTable
+  mutable std::atomic<const AdpcmSeekTable*> seekTable{nullptr};
+
 public:
-  SoundWaveInfo* info;
-  SoundWaveData* waveData;
+  const SoundWaveInfo* info;
+  const SoundWaveData* waveData;
 
-  void* infoBase;
-  void* waveDataBase;
+  const void* infoBase;
+  const void* waveDataBase;
 
-  SoundWave(void* fileData, size_t fileSize);
-  const u32* getChannelInfoOffsets() const { return getOffsetT<u32>(infoBase, info->channelInfoTableOffset); }
+  SoundWave(const void* fileData, size_t fileSize);
+  ~SoundWave();
+  SoundWave(const SoundWave&) = delete;
+  SoundWave& operator=(const SoundWave&) = delete;
+  const be<u32>* getChannelInfoOffsets() const { return getOffsetT<be<u32>>(infoBase, info->channelInfoTableOffset); }
   const SoundWaveChannelInfo* getChannelInfo(u8 idx) const { return getOffsetT<SoundWaveChannelInfo>(infoBase, getChannelInfoOffsets()[idx]); }
   const AdpcParams* getChannelAdpcmParam(u8 idx) const { return getOffsetT<AdpcParams>(infoBase, getChannelInfo(idx)->adpcmOffset); }
   const u8* getChannelData(u32 idx) const {
-    void* waveBase2;
+    const void* waveBase2;
     switch (info->dataLocType) {
     case SoundWaveInfo::LOC_OFFSET:
       waveBase2 = getOffset(waveDataBase, 0);
       break;
     case SoundWaveInfo::LOC_ADDR:
-      waveBase2 = reinterpret_cast<void*>(info->dataLoc);
+      waveBase2 = reinterpret_cast<const void*>(static_cast<uintptr_t>(info->dataLoc.load()));
       break;
     default:
       return nullptr;
     }
     return getOffsetT<const u8>(waveBase2, getChannelInfo(idx)->dataOffset);
   }
+  std::vector<ChannelData> getChannels() const;
+  // ADPCM seek table, built by the first call with one decode pass. nullptr for PCM waves
+  const AdpcmSeekTable* getSeekTable() const;
+  bool hasSeekTable() const { return seekTable.load(std::memory_order_acquire) != nullptr; }
   void decodeChannel(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  // decodes sampleCount samples per channel from startSample on, interleaved into buffer.
+  // ADPCM goes through the seek table. Returns the samples per channel written
+  u32 decodeRange(u32 startSample, u32 sampleCount, s16* buffer) const;
+  // decodeRange from loopOffset samples into a repeat of the loop body. An ADPCM loop starting on a
+  // frame boundary decodes the rest of the seek table entry covering the loop start from the loop point
+  // context (AdpcmParamLoop). Other loops use the linear history
+  u32 decodeLoopRange(u32 loopOffset, u32 sampleCount, s16* buffer) const;
   s16* getChannelPcm(u8 channelIdx) const;
   u8 getChannelCount() const { return info->channelCount; }
-  u32 getLoopStart() const;
-  u32 getLoopEnd() const;
+  bool isLooped() const { return info->loop; }
+  u32 getLoopStart() const { return info->getLoopStart(); }
+  u32 getLoopEnd() const { return info->getLoopEnd(); }
   u32 getTrackSampleCount() const;
   u32 getTrackSampleRate() const { return info->sampleRate; }
   u32 getTrackSampleBufferSize() const { return getChannelCount() * getTrackSampleCount() * sizeof(s16); }
+  // decodes the whole track interleaved into buffer, which holds getTrackSampleBufferSize() bytes
+  void decodeTrack(s16* buffer) const;
   s16* getTrackPcm() const;
   void toWaveFile(std::filesystem::path wavePath) const;
 };
@@ -7,47 +7,39 @@
 
 namespace rsnd {
 struct SoundWaveArchiveHeader : public BinaryFileHeader {
-  u32 tableOffset;
-  u32 tableLength;
-  u32 waveDataOffset;
-  u32 waveDataLength;
-
-  void bswap();
+  be<u32> tableOffset;
+  be<u32> tableLength;
+  be<u32> waveDataOffset;
+  be<u32> waveDataLength;
 };
 
 struct SoundWaveArchiveEntry {
   DataRef waveFileRef;
-  u32 waveFileSize;
-
-  void bswap();
+  be<u32> waveFileSize;
 };
 
 struct SoundWaveArchiveTable : public BinaryBlockHeader {
   Array<SoundWaveArchiveEntry> entries;
-
-  void bswap();
 };
 
 struct SoundWaveArchiveData : public BinaryBlockHeader {
-
-  void bswap();
 };
 
 class SoundWaveArchive {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
 public:
-  SoundWaveArchiveTable* table;
-  SoundWaveArchiveData* waveData;
+  const SoundWaveArchiveTable* table;
+  const SoundWaveArchiveData* waveData;
 
-  void* dataBase;
+  const void* dataBase;
 
-  SoundWaveArchive(void* fileData, size_t fileSize);
+  SoundWaveArchive(const void* fileData, size_t fileSize);
   u32 getWaveCount() const { return table->entries.size; }
   const SoundWaveArchiveEntry* getWaveEntry(u32 i) const { return &table->entries.elems[i]; }
-  void* getWaveFile(u32 i, size_t& fileSize) const {
+  const void* getWaveFile(u32 i, size_t& fileSize) const {
     auto waveEntry = getWaveEntry(i);
     fileSize = waveEntry->waveFileSize;
     return waveEntry->waveFileRef.getAddr(dataBase);
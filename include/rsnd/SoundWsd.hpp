@@ -2,36 +2,32 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 
 #include "common/util.h"
 #include "rsnd/soundCommon.hpp"
+#include "rsnd/AdpcmSeekTable.hpp"
 
 namespace rsnd {
 struct WsdHeader : public BinaryFileHeader {
-  u32 dataOffset;
-  u32 dataLength;
-  u32 waveOffset;
-  u32 waveLength;
-
-  void bswap();
+  be<u32> dataOffset;
+  be<u32> dataLength;
+  be<u32> waveOffset;
+  be<u32> waveLength;
 };
 
 struct WsdData : public BinaryBlockHeader {
   Array<DataRef> refs;
-
-  void bswap();
 };
 
 struct Wsd {
   DataRef wsdInfo;
   DataRef trackTable;
   DataRef noteTable;
-
-  void bswap();
 };
 
 struct WsdInfo {
-  f32 pitch;
+  be<f32> pitch;
   u8 pan;
   u8 surroundPan;
   u8 fxSendA;
@@ -41,34 +37,28 @@ struct WsdInfo {
   s8 _a[2];
   DataRef _c;
   DataRef _14;
-  u32 _1c;
-
-  void bswap();
+  be<u32> _1c;
 };
 
 typedef Array<DataRef> WsdTrackTable;
 
 struct TrackInfo {
   DataRef noteEventTable;
-
-  void bswap();
 };
 
 typedef Array<DataRef> NoteEventTable;
 
 struct NoteEvent {
-  f32 position;
-  f32 length;
-  u32 noteIdx;
-  u32 _c;
-
-  void bswap();
+  be<f32> position;
+  be<f32> length;
+  be<u32> noteIdx;
+  be<u32> _c;
 };
 
 typedef Array<DataRef> NoteTable;
 
 struct NoteInformationEntry {
-  s32 waveIdx;
+  be<s32> waveIdx;
   s8 attack;
   s8 decay;
   s8 sustain;
@@ -81,78 +71,83 @@ struct NoteInformationEntry {
   u8 volume;
   u8 pan;
   u8 surroundPan;
-  f32 pitch;
+  be<f32> pitch;
   DataRef lfoTable;
   DataRef graphEnvTable;
   DataRef randomizerTable;
-  u32 _res;
-
-  void bswap();
+  be<u32> _res;
 };
 
 struct WsdWaveOld : public BinaryBlockHeader {
   // offsets to wave info
-  u32 elems[ 1 ];
-
-  void bswap();
+  be<u32> elems[ 1 ];
 };
 
 struct WsdWave : public BinaryBlockHeader {
   // offsets to wave info
-  Array<u32> waveInfos;
-
-  void bswap();
+  Array<be<u32>> waveInfos;
 };
 
 class SoundWsd {
 private:
-  void* data;
+  const void* data;
   size_t dataSize;
 
+  AdpcmSeekTableCache seekTables;
+
 public:
-  WsdHeader* wsdHdr;
+  const WsdHeader* wsdHdr;
   static const int FILE_VERSION_NEW_WAVE_BLOCK = 0x0101;
 
-  WsdData* wsdData;
-  void* wsdWave;
+  const WsdData* wsdData;
+  const void* wsdWave;
 
-  void* dataBase;
-  void* waveBase;
+  const void* dataBase;
+  const void* waveBase;
 
   bool containsWaveInfo;
 
-  SoundWsd(void* fileData, size_t fileSize, void* waveData=nullptr);
+  SoundWsd(const void* fileData, size_t fileSize);
 
   u32 getWsdCount() const { return wsdData->refs.size; }
   const Wsd* getWsd(u32 i) const { return wsdData->refs.elems[i].getAddr<const Wsd>(dataBase); }
   u32 getTrackCount(const Wsd* wsd) const { return wsd->trackTable.getAddr<WsdTrackTable>(dataBase)->size; }
   const TrackInfo* getTrackInfo(const Wsd* wsd, int i) const { return wsd->trackTable.getAddr<WsdTrackTable>(dataBase)->elems[i].getAddr<TrackInfo>(dataBase); }
   const NoteEventTable* getTrackNoteEventTable(const Wsd* wsd, int i) const { return getTrackInfo(wsd, i)->noteEventTable.getAddr<NoteEventTable>(dataBase); }
+  u32 getNoteCount(const Wsd* wsd) const { return wsd->noteTable.getAddr<NoteTable>(dataBase)->size; }
+  const NoteInformationEntry* getNoteInfo(const Wsd* wsd, int i) const { return wsd->noteTable.getAddr<NoteTable>(dataBase)->elems[i].getAddr<NoteInformationEntry>(dataBase); }
 
   const WaveInfo* getWaveInfo(int i) const {
     if (wsdHdr->version >= SoundWsd::FILE_VERSION_NEW_WAVE_BLOCK) {
-      WsdWave* waveNew = static_cast<WsdWave*>(wsdWave);
+      const WsdWave* waveNew = static_cast<const WsdWave*>(wsdWave);
       return getOffsetT<WaveInfo>(waveBase, waveNew->waveInfos.elems[i]);
     } else {
-      WsdWaveOld* waveOld = static_cast<WsdWaveOld*>(wsdWave);
+      const WsdWaveOld* waveOld = static_cast<const WsdWaveOld*>(wsdWave);
       return getOffsetT<WaveInfo>(waveBase, waveOld->elems[i]);
     }
   }
   int getWaveInfoCount() const {
     if (wsdHdr->version >= SoundWsd::FILE_VERSION_NEW_WAVE_BLOCK) {
-      WsdWave* waveNew = static_cast<WsdWave*>(wsdWave);
+      const WsdWave* waveNew = static_cast<const WsdWave*>(wsdWave);
       return waveNew->waveInfos.size;
     } else {
-      WsdWaveOld* waveOld = static_cast<WsdWaveOld*>(wsdWave);
+      const WsdWaveOld* waveOld = static_cast<const WsdWaveOld*>(wsdWave);
       return (waveOld->length - 8) / sizeof(u32);
     }
   }
   const SoundWaveChannelInfo* getChannelInfo(const WaveInfo* waveInfo, int i) const { 
-    const u32* channelInfoOffsets = getOffsetT<u32>(waveInfo, waveInfo->channelInfoTableOffset);
+    const be<u32>* channelInfoOffsets = getOffsetT<be<u32>>(waveInfo, waveInfo->channelInfoTableOffset);
     return getOffsetT<SoundWaveChannelInfo>(waveInfo, channelInfoOffsets[i]);
   }
   const AdpcParams* getAdpcParams(const WaveInfo* waveInfo, const SoundWaveChannelInfo* chInfo) const { return getOffsetT<AdpcParams>(waveInfo, chInfo->adpcmOffset); }
+  // see SoundBank::getWaveSeekTable/decodeWaveRange
+  const AdpcmSeekTable* getWaveSeekTable(int i, const void* waveData) const { return seekTables.get(getWaveInfo(i), waveData); }
+  u32 decodeWaveRange(int i, const void* waveData, u32 startSample, u32 sampleCount, s16* buffer) const {
+    return seekTables.decodeRange(getWaveInfo(i), waveData, startSample, sampleCount, buffer);
+  }
 
-  void trackToWaveFile(u8 trackIdx, void* waveData, std::filesystem::path wavePath) const;
+  // decodes a wave up to its loop end interleaved into buffer, which holds channelCount * getLoopEnd() samples
+  void decodeWave(u8 trackIdx, const void* waveData, s16* buffer) const;
+  void trackToWaveFile(u8 trackIdx, const void* waveData, std::filesystem::path wavePath) const;
 };
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string_view>
+
+namespace rsnd {
+// instruction sets decodeAdpcmChannels/decodePcmChannels can pick their kernels from
+enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE41,
+  SIMD_AVX2,
+};
+
+// best level this CPU supports, always SIMD_SCALAR outside x86-64
+SimdLevel detectSimdLevel();
+// level in use. Picked on first use: MRST_SIMD (scalar, sse4.1 or avx2) if set, detectSimdLevel() otherwise
+SimdLevel getSimdLevel();
+// forces a level for A/B testing, capped at what the CPU supports. Call before decoding starts
+void setSimdLevel(SimdLevel level);
+
+const char* getSimdLevelName(SimdLevel level);
+bool parseSimdLevel(std::string_view name, SimdLevel& level);
+}
@@ -2,8 +2,10 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "common/types.h"
+#include "common/util.h"
 
 // cred: https://github.com/kiwi515/ogws/blob/6dab7b21952c545ded976fb54ef0a83d7a3b9a52/include/revolution/AX/AXPB.h#L8
 /**
@@ -27,39 +29,31 @@
 namespace rsnd {
 
 struct SoundWaveChannelInfo {
-  u32 dataOffset;
-  u32 adpcmOffset;
-  u32 frontLeftVolume;
-  u32 frontRightVolume;
-  u32 backLeftVolume;
-  u32 backRightVolume;
-
-  void bswap();
+  be<u32> dataOffset;
+  be<u32> adpcmOffset;
+  be<u32> frontLeftVolume;
+  be<u32> frontRightVolume;
+  be<u32> backLeftVolume;
+  be<u32> backRightVolume;
 };
 
 struct AdpcmParam {
-  s16 coeffs[16];
-  u16 gain;
-  u16 predictorScale;
-  s16 yn1;
-  s16 yn2;
-
-  void bswap();
+  be<s16> coeffs[16];
+  be<u16> gain;
+  be<u16> predictorScale;
+  be<s16> yn1;
+  be<s16> yn2;
 };
 
 struct AdpcmParamLoop {
-  u16 predictorScale;
-  s16 yn1;
-  s16 yn2;
-
-  void bswap();
+  be<u16> predictorScale;
+  be<s16> yn1;
+  be<s16> yn2;
 };
 
 struct AdpcParams {
   AdpcmParam params;
   AdpcmParamLoop paramsLoop;
-
-  void bswap();
 };
 
 struct WaveInfo {
@@ -74,17 +68,19 @@ struct WaveInfo {
   bool loop;
   u8 channelCount;
   u8 sampleRate24;
-  u16 sampleRate;
+  be<u16> sampleRate;
   u8 dataLocType;
   u8 _7;
-  u32 loopStart;
-  u32 loopEnd;
-  u32 channelInfoTableOffset;
-  u32 dataLoc;
-  u32 _18;
+  // DSP addresses, use getLoopStart/getLoopEnd for sample positions
+  be<u32> loopStart;
+  be<u32> loopEnd;
+  be<u32> channelInfoTableOffset;
+  be<u32> dataLoc;
+  be<u32> _18;
 
-  void bswap();
   u32 getSampleRate() const { return (sampleRate24 << 16) + sampleRate; }
+  u32 getLoopStart() const;
+  u32 getLoopEnd() const;
 };
 
 inline u32 dspAddressToSamples(u32 samples) {
@@ -97,9 +93,40 @@ u32 sampleByDspAddress(u32 sample, u8 format);
 
 void decodePcm8Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride);
 void decodePcm16Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride);
-void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const s16 coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride);
+void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const be<s16> coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride);
+// straightforward per-sample decoder, kept as the reference decodeAdpcmBlock is checked against
+void decodeAdpcmBlockRef(const u8* blockData, u32 sampleCount, const be<s16> coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride);
 void decodeBlock(const u8* blockData, u32 sampleCount, s16* blockBuffer, u8 stride, u8 format, const AdpcParams* adpcParams);
 
+// one channel of encoded samples, coeffs/yn1/yn2 are only used for ADPCM
+struct ChannelData {
+  const u8* data;
+  const be<s16>* coeffs;
+  s16 yn1;
+  s16 yn2;
+
+  // adpcParams is only read for ADPCM
+  static ChannelData make(const u8* data, u8 format, const AdpcParams* adpcParams) {
+    if (format != WaveInfo::FORMAT_ADPCM) return { data, nullptr, 0, 0 };
+    return { data, adpcParams->params.coeffs, adpcParams->params.yn1, adpcParams->params.yn2 };
+  }
+};
+
+// channels of a bank or WSD wave, their samples are at waveInfo->dataLoc in waveData (the RWAR's wave data
+// or the old embedded block)
+std::vector<ChannelData> getWaveChannels(const WaveInfo* waveInfo, const void* waveData);
+
+// decodes channels of equal length side by side, channel i goes to buffer[sample * stride + i].
+// The format is switched on once per call, callers hand over a whole wave or stream block
+void decodeInterleaved(u8 format, const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride);
+// decodes samples [firstSample, firstSample + sampleCount) of channels whose data and history start at
+// sample 0 into buffer with a stride of channelCount. ADPCM has to decode the skipped head as well
+void decodeInterleavedRange(u8 format, const ChannelData* channels, u32 channelCount, u32 firstSample, u32 sampleCount, s16* buffer);
+// per format parts of decodeInterleaved. These use SSE4.1/AVX2 as chosen by getSimdLevel(), the output
+// is identical to the scalar kernels
+void decodeAdpcmChannels(const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride);
+void decodePcmChannels(const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride, u8 format);
+
 constexpr u32 MAGIC_FOURCC(const char (&magic)[4]) {
     return (static_cast<u32>(magic[0]) << 24) |
            (static_cast<u32>(magic[1]) << 16) |
@@ -118,10 +145,10 @@ enum FileFormat {
   FMT_BRWSD,
 };
 
-FileFormat detectFileFormat(const std::string& filename, void* fileData, size_t fileSize);
-u32 detectFileSize(void* fileData);
+FileFormat detectFileFormat(const std::string& filename, const void* fileData, size_t fileSize);
+u32 detectFileSize(const void* fileData);
 
-std::string getFileFourcc(void* data);
+std::string getFileFourcc(const void* data);
 inline bool isFalseEndian(u32 bom) { return bom != 0xFEFF; }
 
 const char* getFormatString(u8 format);
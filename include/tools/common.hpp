@@ -2,7 +2,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace rsnd {
-std::string magicLowercase(void* fileData);
+std::string magicLowercase(const void* fileData);
+// shell style wildcard match, supports * and ?
+bool globMatch(std::string_view pattern, std::string_view str);
 }
\ No newline at end of file
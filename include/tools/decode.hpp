@@ -1,8 +1,12 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "common/cli.h"
 
 namespace rsnd {
 void rsndDecode(CliOpts& cliOpts);
+// same on a file already in memory, cliOpts.inputFile only names the outputs
+void rsndDecodeData(const void* inputData, size_t inputSize, CliOpts& cliOpts);
 }
\ No newline at end of file
@@ -1,11 +1,108 @@
 
+#include <algorithm>
 #include <iostream>
 #include <bit>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "common/fileUtil.hpp"
 #include "common/util.h"
 
 namespace rsnd {
+MappedFile::MappedFile(const std::filesystem::path& filepath) : fileData(nullptr), fileSize(0), mapped(false) {
+#ifdef _WIN32
+  HANDLE file = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cerr << "Failed to open file " << filepath << std::endl;
+    exit(-1);
+  }
+
+  LARGE_INTEGER size;
+  if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+      fileData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+      if (fileData) {
+        fileSize = size.QuadPart;
+        mapped = true;
+      }
+    }
+  }
+  CloseHandle(file);
+#else
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open file " << filepath << std::endl;
+    exit(-1);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      fileData = addr;
+      fileSize = st.st_size;
+      mapped = true;
+    }
+  }
+  close(fd);
+#endif
+
+  if (!mapped) readBuffered(filepath);
+}
+
+MappedFile::~MappedFile() {
+  if (!fileData) return;
+  if (mapped) {
+#ifdef _WIN32
+    UnmapViewOfFile(fileData);
+#else
+    munmap(fileData, fileSize);
+#endif
+  } else {
+    free(fileData);
+  }
+}
+
+void MappedFile::readBuffered(const std::filesystem::path& filepath) {
+  // size is not known up front for pipes, so grow the buffer until EOF
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file " << filepath << std::endl;
+    exit(-1);
+  }
+
+  size_t capacity = 1 << 20;
+  fileData = malloc(capacity);
+  while (fileData) {
+    file.read(static_cast<char*>(fileData) + fileSize, capacity - fileSize);
+    fileSize += file.gcount();
+    if (!file) break;
+
+    capacity *= 2;
+    void* grown = realloc(fileData, capacity);
+    if (!grown) free(fileData);
+    fileData = grown;
+  }
+
+  if (!fileData) {
+    std::cerr << "Failed to allocate memory for file " << filepath << std::endl;
+    exit(-1);
+  }
+}
+
 void* readBinary(const std::filesystem::path& filepath, size_t& size) {
   std::ifstream file(filepath, std::ios::binary | std::ios::ate);
   if (!file.is_open()) {
@@ -28,7 +125,7 @@ void* readBinary(const std::filesystem::path& filepath, size_t& size) {
   return fileData;
 }
 
-void writeBinary(const std::filesystem::path& filepath, void* data, size_t size) {
+void writeBinary(const std::filesystem::path& filepath, const void* data, size_t size) {
   std::ofstream outFile(filepath, std::ios::out | std::ios::binary);
   if (!outFile) {
     std::cerr << "Error opening file " << filepath << " for writing!" << std::endl;
@@ -39,35 +136,158 @@ void writeBinary(const std::filesystem::path& filepath, void* data, size_t size)
   outFile.close();
 }
 
-void createWaveFile(const std::filesystem::path& filepath, void* pcmData, int numSamples, int sampleRate, int numChannels) {
-  std::ofstream wavFile(filepath, std::ios::binary);
-  if (!wavFile.is_open()) {
+WaveWriter::WaveWriter(const std::filesystem::path& filepath, u32 sampleRate, u16 numChannels, u64 expectedSamples)
+  : filepath(filepath), bufferUsed(0), numChannels(numChannels), numSamples(0) {
+  // our buffer replaces the stream's, each flush is one large write. Only honoured before open()
+  file.rdbuf()->pubsetbuf(nullptr, 0);
+  file.open(filepath, std::ios::binary);
+  if (!file.is_open()) {
     std::cerr << "Failed to create WAV file: " << filepath << std::endl;
     return;
   }
+  // plain RIFF when the expected data surely fits in 32 bit sizes
+  rf64Reserved = expectedSamples == UNKNOWN_LENGTH ||
+    expectedSamples * numChannels * sizeof(s16) > UINT32_MAX - RIFF_HEADER_SIZE - RF64_RESERVE_SIZE;
+  buffer.resize(BUFFER_SIZE);
+  writeHeader(sampleRate);
+}
 
-  // Write WAV header
-  const int bitsPerSample = 8 * sizeof(s16);
-  const int byteRate = sampleRate * numChannels * sizeof(s16);
-  const int blockAlign = numChannels * sizeof(s16);
-  const int dataSectionSize = numSamples * numChannels * sizeof(s16);
-  const int fileSize = dataSectionSize + 36;
-
-  wavFile.write("RIFF", 4);                                  // RIFF header
-  wavFile.write(reinterpret_cast<const char*>(&fileSize), 4);  // File size
-  wavFile.write("WAVE", 4);                                  // WAVE header
-  wavFile.write("fmt ", 4);                                  // fmt subchunk header
-  wavFile.write(reinterpret_cast<const char*>("\x10\x00\x00\x00"), 4);  // Subchunk size (16 for PCM)
-  wavFile.write(reinterpret_cast<const char*>("\x01\x00"), 2);  // Audio format (PCM)
-  wavFile.write(reinterpret_cast<const char*>(&numChannels), 2);  // Number of channels
-  wavFile.write(reinterpret_cast<const char*>(&sampleRate), 4);   // Sample rate
-  wavFile.write(reinterpret_cast<const char*>(&byteRate), 4);      // Byte rate
-  wavFile.write(reinterpret_cast<const char*>(&blockAlign), 2);    // Block align
-  wavFile.write(reinterpret_cast<const char*>(&bitsPerSample), 2); // Bits per sample
-  wavFile.write("data", 4);                                  // Data subchunk header
-  wavFile.write(reinterpret_cast<const char*>(&dataSectionSize), 4);  // Data size
-
-  // WAV data
-  wavFile.write(reinterpret_cast<const char*>(pcmData), dataSectionSize);
-}
-}
\ No newline at end of file
+WaveWriter::~WaveWriter() {
+  close();
+}
+
+static char* putTag(char* out, const char (&tag)[5]) {
+  memcpy(out, tag, 4);
+  return out + 4;
+}
+
+// WAV fields are little endian, like every host we build for
+template<typename T>
+static char* putLe(char* out, T value) {
+  memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+void WaveWriter::writeHeader(u32 sampleRate) {
+  const u16 bitsPerSample = 8 * sizeof(s16);
+  const u32 byteRate = sampleRate * numChannels * sizeof(s16);
+  const u16 blockAlign = numChannels * sizeof(s16);
+
+  // sizes are patched on close, the header goes out with the first flush
+  char* out = buffer.data();
+  out = putTag(out, "RIFF");
+  out = putLe<u32>(out, 0);                           // File size
+  out = putTag(out, "WAVE");
+  if (rf64Reserved) {
+    out = putTag(out, "JUNK");
+    out = putLe<u32>(out, RF64_RESERVE_SIZE - 8);
+    memset(out, 0, RF64_RESERVE_SIZE - 8);
+    out += RF64_RESERVE_SIZE - 8;
+  }
+  out = putTag(out, "fmt ");
+  out = putLe<u32>(out, 16);                          // Subchunk size (16 for PCM)
+  out = putLe<u16>(out, 1);                           // Audio format (PCM)
+  out = putLe(out, numChannels);
+  out = putLe(out, sampleRate);
+  out = putLe(out, byteRate);
+  out = putLe(out, blockAlign);
+  out = putLe(out, bitsPerSample);
+  out = putTag(out, "data");
+  out = putLe<u32>(out, 0);                           // Data size
+  bufferUsed = out - buffer.data();
+}
+
+void WaveWriter::flush() {
+  file.write(buffer.data(), bufferUsed);
+  bufferUsed = 0;
+}
+
+void WaveWriter::write(const s16* pcm, u64 count) {
+  if (!file.is_open()) return;
+  const char* bytes = reinterpret_cast<const char*>(pcm);
+  u64 remaining = count * numChannels * sizeof(s16);
+  numSamples += count;
+  while (remaining > 0) {
+    if (bufferUsed == 0 && remaining >= BUFFER_SIZE) {
+      // whole buffers worth of input skip the copy
+      u64 direct = remaining / BUFFER_SIZE * BUFFER_SIZE;
+      file.write(bytes, direct);
+      bytes += direct;
+      remaining -= direct;
+      continue;
+    }
+    size_t n = std::min<u64>(remaining, BUFFER_SIZE - bufferUsed);
+    memcpy(buffer.data() + bufferUsed, bytes, n);
+    bufferUsed += n;
+    bytes += n;
+    remaining -= n;
+    if (bufferUsed == BUFFER_SIZE) flush();
+  }
+}
+
+void WaveWriter::close() {
+  if (!file.is_open()) return;
+  flush();
+  if (!file) {
+    // e.g. a full disk, don't leave a file whose header claims more than was written
+    fail();
+    return;
+  }
+  const u32 headerSize = RIFF_HEADER_SIZE + (rf64Reserved ? RF64_RESERVE_SIZE : 0);
+  const u64 dataSectionSize = numSamples * numChannels * sizeof(s16);
+  const u64 riffSize = dataSectionSize + headerSize - 8;
+
+  if (riffSize <= UINT32_MAX) {
+    const u32 riffSize32 = riffSize;
+    const u32 dataSectionSize32 = dataSectionSize;
+    file.seekp(4);
+    file.write(reinterpret_cast<const char*>(&riffSize32), 4);
+    file.seekp(headerSize - 4);
+    file.write(reinterpret_cast<const char*>(&dataSectionSize32), 4);
+  } else if (rf64Reserved) {
+    char header[RF64_HEADER_SIZE];
+    putRf64Header(header, numSamples, numChannels);
+    file.seekp(0);
+    file.write(header, sizeof(header));
+    const u32 dataSectionSize32 = UINT32_MAX;
+    file.seekp(headerSize - 4);
+    file.write(reinterpret_cast<const char*>(&dataSectionSize32), 4);
+  } else {
+    std::cerr << "Warning: WAV data exceeds 4 GiB without room for an RF64 header, sizes are truncated\n";
+    const u32 size32 = UINT32_MAX;
+    file.seekp(4);
+    file.write(reinterpret_cast<const char*>(&size32), 4);
+    file.seekp(headerSize - 4);
+    file.write(reinterpret_cast<const char*>(&size32), 4);
+  }
+  file.close();
+  if (!file) fail();
+}
+
+void WaveWriter::putRf64Header(char* out, u64 numSamples, u16 numChannels) {
+  // RF64: the 32 bit sizes are all ones and the real ones live in ds64
+  const u64 dataSectionSize = numSamples * numChannels * sizeof(s16);
+  const u64 riffSize = dataSectionSize + RIFF_HEADER_SIZE + RF64_RESERVE_SIZE - 8;
+  out = putTag(out, "RF64");
+  out = putLe<u32>(out, UINT32_MAX);
+  out = putTag(out, "WAVE");
+  out = putTag(out, "ds64");
+  out = putLe<u32>(out, RF64_RESERVE_SIZE - 8);
+  out = putLe(out, riffSize);
+  out = putLe(out, dataSectionSize);
+  out = putLe(out, numSamples);
+  out = putLe<u32>(out, 0);                           // Table length
+}
+
+void WaveWriter::fail() {
+  std::cerr << "Failed to write WAV file: " << filepath << std::endl;
+  if (file.is_open()) file.close();
+  std::error_code ec;
+  std::filesystem::remove(filepath, ec);
+}
+
+void createWaveFile(const std::filesystem::path& filepath, const void* pcmData, u64 numSamples, u32 sampleRate, u16 numChannels) {
+  WaveWriter writer(filepath, sampleRate, numChannels, numSamples);
+  writer.write(static_cast<const s16*>(pcmData), numSamples);
+}
+}
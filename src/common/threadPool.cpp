@@ -0,0 +1,121 @@
+#include "common/threadPool.hpp"
+
+namespace rsnd {
+// queue owned by the current thread, if it is a worker of some pool
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount) : queuedTasks(0), stopping(false) {
+  if (threadCount == 0) threadCount = 1;
+  for (unsigned i = 0; i < threadCount; i++) {
+    queues.push_back(std::make_unique<TaskQueue>());
+  }
+  for (unsigned i = 0; i + 1 < threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& worker : workers) worker.join();
+}
+
+size_t ThreadPool::ownQueue() const {
+  return currentPool == this ? currentQueue : queues.size() - 1;
+}
+
+void ThreadPool::push(size_t queueIdx, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(queues[queueIdx]->mutex);
+    queues[queueIdx]->tasks.push_back(std::move(task));
+  }
+  queuedTasks++;
+  // taking the lock orders this push against a worker checking queuedTasks before sleeping
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wake.notify_one();
+}
+
+bool ThreadPool::runOne(size_t queueIdx) {
+  std::function<void()> task;
+  for (size_t i = 0; i < queues.size() && !task; i++) {
+    TaskQueue& queue = *queues[(queueIdx + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    if (i == 0) {
+      // own queue: newest first
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      // steal: oldest first
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task) return false;
+
+  queuedTasks--;
+  task();
+  return true;
+}
+
+void ThreadPool::workerLoop(size_t queueIdx) {
+  currentPool = this;
+  currentQueue = queueIdx;
+  while (true) {
+    if (runOne(queueIdx)) continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this] { return stopping || queuedTasks > 0; });
+    if (stopping && queuedTasks == 0) return;
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+  if (workers.empty() || count <= 1) {
+    for (size_t i = 0; i < count; i++) fn(i);
+    return;
+  }
+
+  std::atomic<size_t> remaining(count);
+  size_t queueIdx = ownQueue();
+  // pushed in reverse so the owner, which pops newest first, runs them in order
+  for (size_t i = count; i-- > 0;) {
+    push(queueIdx, [this, &fn, &remaining, i] {
+      fn(i);
+      if (--remaining == 0) {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_all();
+      }
+    });
+  }
+
+  // help out until every task of this batch is done
+  while (remaining > 0) {
+    if (runOne(queueIdx)) continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this, &remaining] { return remaining == 0 || queuedTasks > 0; });
+  }
+}
+
+unsigned ThreadPool::defaultThreadCount() {
+  unsigned hardwareThreads = std::thread::hardware_concurrency();
+  return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+static unsigned poolThreadCount = 0;
+
+void setThreadCount(unsigned threadCount) {
+  poolThreadCount = threadCount;
+}
+
+ThreadPool& getThreadPool() {
+  // never destroyed: error paths call exit() from worker threads, which must not join themselves
+  static ThreadPool* pool = new ThreadPool(poolThreadCount > 0 ? poolThreadCount : ThreadPool::defaultThreadCount());
+  return *pool;
+}
+}
@@ -0,0 +1,76 @@
+#include "common/waveCache.hpp"
+
+namespace rsnd {
+size_t WaveCache::KeyHash::operator()(const Key& key) const {
+  size_t hash = std::hash<const void*>()(key.archive);
+  hash = hash * 31 + std::hash<size_t>()(key.waveDataOffset);
+  return hash * 31 + std::hash<u32>()(key.waveIdx);
+}
+
+WaveCache::WaveCache(size_t budgetBytes) : usedBytes(0), budgetBytes(budgetBytes) {}
+
+void WaveCache::evict() {
+  while (usedBytes > budgetBytes && !lru.empty()) {
+    auto entry = entries.find(lru.back());
+    usedBytes -= entry->second.sampleCount * sizeof(s16);
+    entries.erase(entry);
+    lru.pop_back();
+  }
+}
+
+WaveCache::Pcm WaveCache::find(const Key& key, size_t sampleCount) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto entry = entries.find(key);
+  if (entry == entries.end() || entry->second.sampleCount != sampleCount) return nullptr;
+  lru.splice(lru.begin(), lru, entry->second.lruPos);
+  return entry->second.pcm;
+}
+
+void WaveCache::insert(const Key& key, Pcm pcm, size_t sampleCount) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // waves larger than the whole budget would only push everything else out
+  if (sampleCount * sizeof(s16) > budgetBytes) return;
+  auto entry = entries.find(key);
+  if (entry != entries.end()) {
+    // decoded concurrently by another caller, or read with another length: the latest one wins
+    usedBytes -= entry->second.sampleCount * sizeof(s16);
+    lru.erase(entry->second.lruPos);
+    entries.erase(entry);
+  }
+  lru.push_front(key);
+  entries.emplace(key, Entry{ std::move(pcm), sampleCount, lru.begin() });
+  usedBytes += sampleCount * sizeof(s16);
+  evict();
+}
+
+WaveCache::Pcm WaveCache::get(const Key& key, size_t sampleCount, const std::function<void(s16*)>& decode) {
+  if (Pcm pcm = find(key, sampleCount)) return pcm;
+  std::shared_ptr<s16> buffer(new s16[sampleCount], std::default_delete<s16[]>());
+  decode(buffer.get());
+  insert(key, buffer, sampleCount);
+  return buffer;
+}
+
+void WaveCache::setBudget(size_t budgetBytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->budgetBytes = budgetBytes;
+  evict();
+}
+
+void WaveCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  lru.clear();
+  entries.clear();
+  usedBytes = 0;
+}
+
+void setWaveCacheBudget(size_t budgetBytes) {
+  getWaveCache().setBudget(budgetBytes);
+}
+
+WaveCache& getWaveCache() {
+  // never destroyed, like the thread pool whose workers may still be using it when exit() is called
+  static WaveCache* cache = new WaveCache(DEFAULT_WAVE_CACHE_BUDGET);
+  return *cache;
+}
+}
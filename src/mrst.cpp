@@ -4,15 +4,20 @@
 #include <filesystem>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 #include <unordered_set>
 #include <random>
+#include <algorithm>
 
 #include "rsnd/SoundWaveArchive.hpp"
 #include "rsnd/SoundArchive.hpp"
 #include "rsnd/SoundWave.hpp"
+#include "rsnd/decodeSimd.hpp"
 #include "common/util.h"
 #include "common/fileUtil.hpp"
 #include "common/cli.h"
+#include "common/threadPool.hpp"
+#include "common/waveCache.hpp"
 #include "tools/extract.hpp"
 #include "tools/decode.hpp"
 #include "tools/list.hpp"
@@ -35,9 +40,15 @@ CliOpts parseArgs(int argc, char** argv) {
   /// default values
   cliOpts.subcommand = "";
   cliOpts.outputPath = "";
+  cliOpts.jobs = 0;
+  cliOpts.simd = "";
+  cliOpts.waveCacheMiB = rsnd::DEFAULT_WAVE_CACHE_BUDGET >> 20;
   cliOpts.extractOpts.decode = false;
   cliOpts.extractOpts.rsarExtractOpts.extractRwars = false;
+  cliOpts.extractOpts.rsarExtractOpts.mergedSf2 = false;
   cliOpts.extractOpts.rsarExtractOpts.extractStyle = EXTRACT_GROUPS;
+  cliOpts.decodeOpts.loops = 0;
+  cliOpts.decodeOpts.fadeSeconds = 0;
   cliOpts.listOpts.groups = false;
   cliOpts.listOpts.sounds = false;
   cliOpts.listOpts.banks = false;
@@ -50,8 +61,19 @@ CliOpts parseArgs(int argc, char** argv) {
     } else if (strcmp(argv[i], "--out") == 0 || strcmp(argv[i], "-o") == 0) {
       if (i == argc - 1) printUsageExit();
       cliOpts.outputPath = argv[++i];
+    } else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.jobs = std::strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--simd") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.simd = argv[++i];
+    } else if (strcmp(argv[i], "--wave-cache") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.waveCacheMiB = std::strtoul(argv[++i], nullptr, 10);
     } else if (strcmp(argv[i], "--extract-rwar") == 0) {
       cliOpts.extractOpts.rsarExtractOpts.extractRwars = true;
+    } else if (strcmp(argv[i], "--merged-sf2") == 0) {
+      cliOpts.extractOpts.rsarExtractOpts.mergedSf2 = true;
     } else if (strcmp(argv[i], "--style") == 0) {
       std::string extractStyle = argv[++i];
       if (extractStyle == "groups") {
@@ -61,6 +83,28 @@ CliOpts parseArgs(int argc, char** argv) {
       } else {
         std::cout << "Unknown extraction style " << extractStyle << '\n';
       }
+    } else if (strcmp(argv[i], "--only") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.extractOpts.rsarExtractOpts.soundFilters.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--manifest") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::ifstream manifest(argv[++i]);
+      if (!manifest) {
+        std::cerr << "Error opening manifest " << argv[i] << '\n';
+        exit(-1);
+      }
+      std::string line;
+      while (std::getline(manifest, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        cliOpts.extractOpts.rsarExtractOpts.soundFilters.push_back(line);
+      }
+    } else if (strcmp(argv[i], "--loops") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.loops = std::strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--fade") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.fadeSeconds = std::max(0.0, std::strtod(argv[++i], nullptr));
     } else if (strcmp(argv[i], "--groups") == 0) {
       cliOpts.listOpts.groups = true;
     } else if (strcmp(argv[i], "--banks") == 0) {
@@ -80,6 +124,10 @@ CliOpts parseArgs(int argc, char** argv) {
     }
     // for decode default output is same filename with different extension
   }
+  // a fade on its own plays the loop once before fading
+  if (cliOpts.decodeOpts.fadeSeconds > 0 && cliOpts.decodeOpts.loops == 0) {
+    cliOpts.decodeOpts.loops = 1;
+  }
 
   // check mandatory fields
   if (cliOpts.subcommand.empty() || cliOpts.inputFile.empty()) {
@@ -101,6 +149,16 @@ namespace fs = std::filesystem;
 
 int main(int argc, char** argv) {
   CliOpts cliOpts = parseArgs(argc, argv);
+  setThreadCount(cliOpts.jobs);
+  setWaveCacheBudget(static_cast<size_t>(cliOpts.waveCacheMiB) << 20);
+  if (!cliOpts.simd.empty()) {
+    SimdLevel simdLevel;
+    if (!parseSimdLevel(cliOpts.simd, simdLevel)) {
+      std::cerr << "Unknown SIMD level " << cliOpts.simd << " (expected scalar, sse4.1 or avx2)\n";
+      exit(-1);
+    }
+    setSimdLevel(simdLevel);
+  }
 
   if (cliOpts.subcommand == "extract") {
     rsndExtract(cliOpts);
@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "rsnd/AdpcmSeekTable.hpp"
+#include "common/threadPool.hpp"
+
+namespace rsnd {
+AdpcmSeekTable::AdpcmSeekTable(const ChannelData* channels, u8 channelCount, u32 sampleCount, u32 intervalFrames)
+  : channelCount(channelCount), sampleCount(sampleCount), entrySamples(std::max<u32>(intervalFrames, 1) * AX_ADPCM_SAMPLES_PER_FRAME) {
+  u32 entryCount = sampleCount == 0 ? 1 : (sampleCount + entrySamples - 1) / entrySamples;
+  history.resize(static_cast<size_t>(entryCount) * channelCount);
+  for (u8 c = 0; c < channelCount; c++) {
+    history[c] = { channels[c].yn1, channels[c].yn2 };
+  }
+
+  // one pass through the wave, the history after each entry is its last two decoded samples
+  std::vector<s16> entryBuffer(static_cast<size_t>(entrySamples) * channelCount);
+  std::vector<ChannelData> entryChannels(channelCount);
+  for (u32 e = 0; e + 1 < entryCount; e++) {
+    for (u8 c = 0; c < channelCount; c++) {
+      entryChannels[c] = getEntryChannel(channels[c], c, e);
+    }
+    decodeInterleaved(WaveInfo::FORMAT_ADPCM, entryChannels.data(), channelCount, entrySamples, entryBuffer.data(), channelCount);
+
+    const s16* last = entryBuffer.data() + static_cast<size_t>(entrySamples - 1) * channelCount;
+    const s16* secondLast = last - channelCount;
+    for (u8 c = 0; c < channelCount; c++) {
+      history[static_cast<size_t>(e + 1) * channelCount + c] = { last[c], secondLast[c] };
+    }
+  }
+}
+
+ChannelData AdpcmSeekTable::getEntryChannel(const ChannelData& channel, u8 channelIdx, u32 entryIdx) const {
+  const History& entry = history[static_cast<size_t>(entryIdx) * channelCount + channelIdx];
+  const u32 entryBytes = entrySamples / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE;
+  return { channel.data + static_cast<size_t>(entryIdx) * entryBytes, channel.coeffs, entry.yn1, entry.yn2 };
+}
+
+u32 AdpcmSeekTable::decodeRange(const ChannelData* channels, u32 startSample, u32 count, s16* buffer) const {
+  if (startSample >= sampleCount) return 0;
+  count = std::min(count, sampleCount - startSample);
+  if (count == 0) return 0;
+
+  const u32 firstEntry = startSample / entrySamples;
+  const u32 lastEntry = (startSample + count - 1) / entrySamples;
+  getThreadPool().parallelFor(lastEntry - firstEntry + 1, [&](size_t i) {
+    u32 e = firstEntry + i;
+    u32 entryStart = e * entrySamples;
+    u32 first = std::max(startSample, entryStart);
+    u32 end = std::min(startSample + count, entryStart + entrySamples);
+
+    std::vector<ChannelData> entryChannels(channelCount);
+    for (u8 c = 0; c < channelCount; c++) {
+      entryChannels[c] = getEntryChannel(channels[c], c, e);
+    }
+    decodeInterleavedRange(WaveInfo::FORMAT_ADPCM, entryChannels.data(), channelCount, first - entryStart, end - first,
+                           buffer + static_cast<size_t>(first - startSample) * channelCount);
+  });
+  return count;
+}
+
+const AdpcmSeekTable* AdpcmSeekTableCache::get(const WaveInfo* waveInfo, const void* waveData) const {
+  if (waveInfo->format != WaveInfo::FORMAT_ADPCM) return nullptr;
+  const auto key = std::make_pair(waveInfo, waveData);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto table = tables.find(key);
+    if (table != tables.end()) return table->second.get();
+  }
+
+  // built outside the lock so other waves aren't held up, threads racing on the same wave keep the first one
+  auto built = std::make_unique<const AdpcmSeekTable>(getWaveChannels(waveInfo, waveData).data(), waveInfo->channelCount, waveInfo->getLoopEnd());
+  std::lock_guard<std::mutex> lock(mutex);
+  return tables.try_emplace(key, std::move(built)).first->second.get();
+}
+
+u32 AdpcmSeekTableCache::decodeRange(const WaveInfo* waveInfo, const void* waveData, u32 startSample, u32 sampleCount, s16* buffer) const {
+  std::vector<ChannelData> channels = getWaveChannels(waveInfo, waveData);
+  if (const AdpcmSeekTable* table = get(waveInfo, waveData)) {
+    return table->decodeRange(channels.data(), startSample, sampleCount, buffer);
+  }
+
+  u32 totalSamples = waveInfo->getLoopEnd();
+  if (startSample >= totalSamples) return 0;
+  sampleCount = std::min(sampleCount, totalSamples - startSample);
+  decodeInterleavedRange(waveInfo->format, channels.data(), channels.size(), startSample, sampleCount, buffer);
+  return sampleCount;
+}
+}
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <utility>
+
+#include "rsnd/LoopRenderer.hpp"
+
+namespace rsnd {
+LoopRenderer::LoopRenderer(RangeDecoder decodeRange, LoopDecoder decodeLoop, u8 channelCount, u32 sourceSamples,
+                           bool loop, u32 loopStart, u32 loopEnd, u32 loopCount, u32 fadeSamples)
+  : decodeRange(std::move(decodeRange)), decodeLoop(std::move(decodeLoop)), channelCount(channelCount), position(0) {
+  loopEnd = std::min(loopEnd, sourceSamples);
+  if (!loop || loopCount == 0 || loopStart >= loopEnd) {
+    this->loopStart = 0;
+    this->loopEnd = sourceSamples;
+    sampleCount = sourceSamples;
+    fadeStart = sampleCount;
+    return;
+  }
+
+  this->loopStart = loopStart;
+  this->loopEnd = loopEnd;
+  fadeStart = loopEnd + static_cast<u64>(loopCount - 1) * (loopEnd - loopStart);
+  sampleCount = fadeStart + fadeSamples;
+}
+
+void LoopRenderer::applyFade(s16* buffer, u32 samples) const {
+  // linear ramp from full volume at fadeStart down to silence at the end
+  const u64 fadeSamples = sampleCount - fadeStart;
+  for (u32 i = 0; i < samples; i++) {
+    u64 samplePos = position + i;
+    if (samplePos < fadeStart) continue;
+    s64 gain = sampleCount - samplePos;
+    for (u8 c = 0; c < channelCount; c++) {
+      s16& sample = buffer[static_cast<size_t>(i) * channelCount + c];
+      sample = static_cast<s16>(sample * gain / static_cast<s64>(fadeSamples));
+    }
+  }
+}
+
+u32 LoopRenderer::read(s16* buffer, u32 maxSamples) {
+  u32 written = 0;
+  while (written < maxSamples && position < sampleCount) {
+    // past the first loop end every position maps back into the loop body
+    u32 sourcePos = position < loopEnd ? position : loopStart + (position - loopStart) % (loopEnd - loopStart);
+    u32 samples = std::min<u64>({maxSamples - written, loopEnd - sourcePos, sampleCount - position});
+    s16* out = buffer + static_cast<size_t>(written) * channelCount;
+
+    u32 decoded = position >= loopEnd ? decodeLoop(sourcePos - loopStart, samples, out) : decodeRange(sourcePos, samples, out);
+    if (decoded < samples) {
+      // the source ended early, finish with silence rather than stall
+      std::fill(out + static_cast<size_t>(decoded) * channelCount, out + static_cast<size_t>(samples) * channelCount, 0);
+    }
+    if (position + samples > fadeStart) applyFade(out, samples);
+
+    position += samples;
+    written += samples;
+  }
+  return written;
+}
+}
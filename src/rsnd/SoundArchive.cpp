@@ -1,291 +1,138 @@
 
-#include <bit>
 #include <iostream>
 
 #include "rsnd/SoundArchive.hpp"
 
 namespace rsnd {
-void SoundArchiveHeader::bswap() {
-  this->BinaryFileHeader::bswap();
-
-  symbBlockOffset = std::byteswap(symbBlockOffset);
-  symbBlockSize = std::byteswap(symbBlockSize);
-  infoBlockOffset = std::byteswap(infoBlockOffset);
-  infoBlockSize = std::byteswap(infoBlockSize);
-  fileBlockOffset = std::byteswap(fileBlockOffset);
-  fileBlockSize = std::byteswap(fileBlockSize);
-}
-
-void SymbHeader::bswap() {
-  this->BinaryBlockHeader::bswap();
-
-  nameTableOffset = std::byteswap(nameTableOffset);
-  soundTreeOffset = std::byteswap(soundTreeOffset);
-  playerTreeOffset = std::byteswap(playerTreeOffset);
-  groupTreeOffset = std::byteswap(groupTreeOffset);
-  bankTreeOffset = std::byteswap(bankTreeOffset);
-}
+SoundArchive::SoundArchive(const void* fileData, size_t fileSize) {
+  dataSize = fileSize;
+  data = fileData;
 
-void StringTreeNode::bswap() {
-  flags = std::byteswap(flags);
-  bit = std::byteswap(bit);
-  leftIdx = std::byteswap(leftIdx);
-  rightIdx = std::byteswap(rightIdx);
-  strIdx = std::byteswap(strIdx);
-  id = std::byteswap(id);
-}
+  const SoundArchiveHeader* sarHdr = static_cast<const SoundArchiveHeader*>(fileData);
 
-void StringTree::bswap() {
-  rootIdx = std::byteswap(rootIdx);
-  nodes.bswap();
-}
+  // ===== SYMB
+  soundArchiveSymb = getOffsetT<SymbHeader>(fileData, sarHdr->symbBlockOffset);
+  symbBase = getOffset(soundArchiveSymb, sizeof(BinaryBlockHeader));
 
-void SoundArchiveInfo::bswap() {
-  this->BinaryBlockHeader::bswap();
+  // ==== FILE
+  soundArchiveFile = getOffsetT<SoundArchiveFile>(fileData, sarHdr->fileBlockOffset);
+  fileBase = getOffset(soundArchiveFile, sizeof(BinaryBlockHeader));
 
-  soundTable.bswap();
-  bankTable.bswap();
-  playerTable.bswap();
-  fileTable.bswap();
-  groupTable.bswap();
-  soundCountTable.bswap();
+  // ==== INFO
+  soundArchiveInfo = getOffsetT<SoundArchiveInfo>(fileData, sarHdr->infoBlockOffset);
+  infoBase = getOffset(soundArchiveInfo, sizeof(BinaryBlockHeader));
 }
 
-void SoundInfoEntry::bswap() {
-  fileNameIdx = std::byteswap(fileNameIdx);
-  fileIdx = std::byteswap(fileIdx);
-  playerId = std::byteswap(playerId);
-  sound3dParam.bswap();
-  extendedInfoRef.bswap();
-  _20 = std::byteswap(_20);
-  _24 = std::byteswap(_24);
+const StringTable* SoundArchive::getStringTable() const {
+  return lazyTable(stringTable, [this] { return getOffsetT<StringTable>(symbBase, soundArchiveSymb->nameTableOffset); });
 }
 
-void SeqSoundInfo::bswap() {
-  offset = std::byteswap(offset);
-  bankIdx = std::byteswap(bankIdx);
-  _8 = std::byteswap(_8);
-  _10 = std::byteswap(_10);
+const StringTree* SoundArchive::getSoundStringTree() const {
+  return lazyTable(soundStringTree, [this] { return getOffsetT<StringTree>(symbBase, soundArchiveSymb->soundTreeOffset); });
 }
 
-void WsdSoundInfo::bswap() {
-  idx = std::byteswap(idx);
-  _4 = std::byteswap(_4);
-  _c = std::byteswap(_c);
+const StringTree* SoundArchive::getPlayerStringTree() const {
+  return lazyTable(playerStringTree, [this] { return getOffsetT<StringTree>(symbBase, soundArchiveSymb->playerTreeOffset); });
 }
 
-void StrmSoundInfo::bswap() {
-  startPos = std::byteswap(startPos);
-  _4 = std::byteswap(_4);
-  _6 = std::byteswap(_6);
-  _8 = std::byteswap(_8);
+const StringTree* SoundArchive::getGroupStringTree() const {
+  return lazyTable(groupStringTree, [this] { return getOffsetT<StringTree>(symbBase, soundArchiveSymb->groupTreeOffset); });
 }
 
-void BankInfo::bswap() {
-  fileNameIdx = std::byteswap(fileNameIdx);
-  fileIdx = std::byteswap(fileIdx);
-  _c = std::byteswap(_c);
+const StringTree* SoundArchive::getBankStringTree() const {
+  return lazyTable(bankStringTree, [this] { return getOffsetT<StringTree>(symbBase, soundArchiveSymb->bankTreeOffset); });
 }
 
-void PlayerInfo::bswap() {
-  fileNameIdx = std::byteswap(fileNameIdx);
-  _8 = std::byteswap(_8);
+const SoundTable* SoundArchive::getSoundTable() const {
+  return lazyTable(soundTable, [this] { return soundArchiveInfo->soundTable.getAddr<SoundTable>(infoBase); });
 }
 
-void FileInfo::bswap() {
-  fileSize = std::byteswap(fileSize);
-  waveDataSize = std::byteswap(waveDataSize);
-  _8 = std::byteswap(_8);
-  externalFileName.bswap();
-  fileGroupInfo.bswap();
+const BankTable* SoundArchive::getBankTable() const {
+  return lazyTable(bankTable, [this] { return soundArchiveInfo->bankTable.getAddr<BankTable>(infoBase); });
 }
 
-void FileGroup::bswap() {
-  groupIdx = std::byteswap(groupIdx);
-  idx = std::byteswap(idx);
+const PlayerTable* SoundArchive::getPlayerTable() const {
+  return lazyTable(playerTable, [this] { return soundArchiveInfo->playerTable.getAddr<PlayerTable>(infoBase); });
 }
 
-void GroupInfo::bswap() {
-  nameIdx = std::byteswap(nameIdx);
-  entryNum = std::byteswap(entryNum);
-  externalFileName.bswap();
-  fileOffset = std::byteswap(fileOffset);
-  fileSize = std::byteswap(fileSize);
-  waveDataOffset = std::byteswap(waveDataOffset);
-  waveDataSize = std::byteswap(waveDataSize);
-  groupItemTable.bswap();
+const FileTable* SoundArchive::getFileTable() const {
+  return lazyTable(fileTable, [this] { return soundArchiveInfo->fileTable.getAddr<FileTable>(infoBase); });
 }
 
-void GroupItemInfo::bswap() {
-  fileIdx = std::byteswap(fileIdx);
-  fileOffset = std::byteswap(fileOffset);
-  fileSize = std::byteswap(fileSize);
-  waveDataOffset = std::byteswap(waveDataOffset);
-  waveDataSize = std::byteswap(waveDataSize);
-  _14 = std::byteswap(_14);
+const GroupTable* SoundArchive::getGroupTable() const {
+  return lazyTable(groupTable, [this] { return soundArchiveInfo->groupTable.getAddr<GroupTable>(infoBase); });
 }
 
-void SoundCountTable::bswap() {
-  seqSoundCount = std::byteswap(seqSoundCount);
-  seqTrackCount = std::byteswap(seqTrackCount);
-  strmSoundCount = std::byteswap(strmSoundCount);
-  strmTrackCount = std::byteswap(strmTrackCount);
-  strmChannelCount = std::byteswap(strmChannelCount);
-  waveSoundCount = std::byteswap(waveSoundCount);
-  waveTrackCount = std::byteswap(waveTrackCount);
+const SoundCountTable* SoundArchive::getSoundCountTable() const {
+  return lazyTable(soundCountTable, [this] { return soundArchiveInfo->soundCountTable.getAddr<SoundCountTable>(infoBase); });
 }
 
-SoundArchive::SoundArchive(void* fileData, size_t fileSize) {
-  dataSize = fileSize;
-  data = fileData;
-
-  SoundArchiveHeader* sarHdr = static_cast<SoundArchiveHeader*>(fileData);
-  sarHdr->bswap();
-
-  // ===== SYMB
-  soundArchiveSymb = static_cast<SymbHeader*>(getOffset(fileData, sarHdr->symbBlockOffset));
-  soundArchiveSymb->bswap();
-  symbBase = getOffset(soundArchiveSymb, sizeof(BinaryBlockHeader));
-
-  stringTable = static_cast<StringTable*>(getOffset(symbBase, soundArchiveSymb->nameTableOffset));
-  stringTable->bswap();
-
-  soundStringTree = static_cast<StringTree*>(getOffset(symbBase, soundArchiveSymb->soundTreeOffset));
-  soundStringTree->bswap();
-
-  playerStringTree = static_cast<StringTree*>(getOffset(symbBase, soundArchiveSymb->playerTreeOffset));
-  playerStringTree->bswap();
-
-  groupStringTree = static_cast<StringTree*>(getOffset(symbBase, soundArchiveSymb->groupTreeOffset));
-  groupStringTree->bswap();
-
-  bankStringTree = static_cast<StringTree*>(getOffset(symbBase, soundArchiveSymb->bankTreeOffset));
-  bankStringTree->bswap();
-
-  // ==== FILE
-  soundArchiveFile = static_cast<SoundArchiveFile*>(getOffset(fileData, sarHdr->fileBlockOffset));
-  soundArchiveFile->bswap();
-  fileBase = getOffset(soundArchiveFile, sizeof(BinaryBlockHeader));
-
-  // ==== INFO
-  soundArchiveInfo = static_cast<SoundArchiveInfo*>(getOffset(fileData, sarHdr->infoBlockOffset));
-  soundArchiveInfo->bswap();
-  infoBase = getOffset(soundArchiveInfo, sizeof(BinaryBlockHeader));
-
-  soundTable = static_cast<SoundTable*>(soundArchiveInfo->soundTable.getAddr(infoBase));
-  soundTable->bswap();
-
-  bankTable = static_cast<BankTable*>(soundArchiveInfo->bankTable.getAddr(infoBase));
-  bankTable->bswap();
-
-  playerTable = static_cast<PlayerTable*>(soundArchiveInfo->playerTable.getAddr(infoBase));
-  playerTable->bswap();
-
-  fileTable = static_cast<FileTable*>(soundArchiveInfo->fileTable.getAddr(infoBase));
-  fileTable->bswap();
-
-  groupTable = static_cast<GroupTable*>(soundArchiveInfo->groupTable.getAddr(infoBase));
-  groupTable->bswap();
-
-  for (int i = 0; i < bankTable->size; i++) {
-    BankInfo* bankInfo = static_cast<BankInfo*>(bankTable->elems[i].getAddr(infoBase));
-    bankInfo->bswap();
-  }
-
-  for (int i = 0; i < playerTable->size; i++) {
-    PlayerInfo* playerInfo = static_cast<PlayerInfo*>(playerTable->elems[i].getAddr(infoBase));
-    playerInfo->bswap();
-  }
+s32 SoundArchive::findId(const StringTree* tree, std::string_view name) const {
+  if (tree->rootIdx >= tree->nodes.size) return -1;
 
-  for (int i = 0; i < fileTable->size; i++) {
-    FileInfo* fileInfo = static_cast<FileInfo*>(fileTable->elems[i].getAddr(infoBase));
-    fileInfo->bswap();
-
-    FileGroupInfo* fileGroupInfo = static_cast<FileGroupInfo*>(fileInfo->fileGroupInfo.getAddr(infoBase));
-    fileGroupInfo->bswap();
-    for (int j = 0; j < fileGroupInfo->size; j++) {
-      FileGroup* fileGroup = static_cast<FileGroup*>(fileGroupInfo->elems[j].getAddr(infoBase));
-      fileGroup->bswap();
+  // patricia tree: inner nodes test one bit of the name, MSB first
+  const StringTreeNode* node = &tree->nodes.elems[tree->rootIdx];
+  // a path visits every node at most once, more steps means the child indices of a malformed tree form a cycle
+  u32 steps = 0;
+  while (!(node->flags & StringTreeNode::FLAG_LEAF)) {
+    if (++steps > tree->nodes.size) return -1;
+    u32 pos = node->bit >> 3;
+    u32 bit = node->bit & 7;
+    u32 nodeIdx;
+    if (pos < name.size() && (name[pos] & (1 << (7 - bit)))) {
+      nodeIdx = node->rightIdx;
+    } else {
+      nodeIdx = node->leftIdx;
     }
+    if (nodeIdx >= tree->nodes.size) return -1;
+    node = &tree->nodes.elems[nodeIdx];
   }
 
-  for (int i = 0; i < groupTable->size; i++) {
-    GroupInfo* groupInfo = static_cast<GroupInfo*>(groupTable->elems[i].getAddr(infoBase));
-    groupInfo->bswap();
-
-    GroupItemTable* groupItemTable = static_cast<GroupItemTable*>(groupInfo->groupItemTable.getAddr(infoBase));
-    groupItemTable->bswap();
-    for (int j = 0; j < groupItemTable->size; j++) {
-      GroupItemInfo* groupItemInfo = static_cast<GroupItemInfo*>(groupItemTable->elems[j].getAddr(infoBase));
-      groupItemInfo->bswap();
-    }
-  }
-
-  soundCountTable = static_cast<SoundCountTable*>(soundArchiveInfo->soundCountTable.getAddr(infoBase));
-  soundCountTable->bswap();
-
-  for (int i = 0; i < soundTable->size; i++) {
-    SoundInfoEntry* soundInfoEntry = static_cast<SoundInfoEntry*>(soundTable->elems[i].getAddr(infoBase));
-    soundInfoEntry->bswap();
-
-    switch (soundInfoEntry->soundType)
-    {
-    case SoundInfoEntry::TYPE_SEQ: {
-      SeqSoundInfo* seqSoundInfo = soundInfoEntry->extendedInfoRef.getAddr<SeqSoundInfo>(infoBase);
-      seqSoundInfo->bswap();
-      break;
-    
-    } case SoundInfoEntry::TYPE_WAVE: {
-      WsdSoundInfo* wsdSoundInfo = soundInfoEntry->extendedInfoRef.getAddr<WsdSoundInfo>(infoBase);
-      wsdSoundInfo->bswap();
-      break;
-    
-    } case SoundInfoEntry::TYPE_STRM: {
-      StrmSoundInfo* strmSoundInfo = soundInfoEntry->extendedInfoRef.getAddr<StrmSoundInfo>(infoBase);
-      strmSoundInfo->bswap();
-      break;
-    
-    } default:
-      std::cerr << "Warning: Unknown sound type " << soundInfoEntry->soundType << '\n';
-      break;
-    }
-  }
+  const char* leafName = getString(node->strIdx);
+  if (!leafName || name != leafName) return -1;
+  return node->id;
 }
 
 const FileGroup* SoundArchive::getFileGroup(u32 fileIdx, u32 fileGroupIdx) const {
   const FileGroupInfo* fileGroupInfo = getFileGroupInfo(fileIdx);
-  return static_cast<FileGroup*>(fileGroupInfo->elems[fileGroupIdx].getAddr(infoBase));
+  return fileGroupInfo->elems[fileGroupIdx].getAddr<FileGroup>(infoBase);
 }
 
-void* SoundArchive::getInternalFileData(u32 fileIdx) const {
+const void* SoundArchive::getInternalFileData(u32 fileIdx, size_t* fileSize) const {
+  const FileGroupInfo* fileGroupInfo = getFileGroupInfo(fileIdx);
+  if (!fileGroupInfo || fileGroupInfo->size == 0) return nullptr; // external file
   const FileGroup* fileGroup = getFileGroup(fileIdx, 0);
   const GroupInfo* groupInfo = getGroupInfo(fileGroup->groupIdx);
-  char* externalFileName = static_cast<char*>(groupInfo->externalFileName.getAddr(infoBase));
+  const char* externalFileName = groupInfo->externalFileName.getAddr<char>(infoBase);
   if (externalFileName) return nullptr; // file belongs to external group
 
   const GroupItemInfo* groupItemInfo = getGroupItemInfo(fileGroup->groupIdx, fileGroup->idx);
   u32 offset = groupInfo->fileOffset + groupItemInfo->fileOffset;
+  if (fileSize) *fileSize = groupItemInfo->fileSize;
   return getOffset(data, offset);
 }
 
-void* SoundArchive::getInternalFileData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize) const {
+const void* SoundArchive::getInternalFileData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize) const {
   u32 offset = groupInfo->fileOffset + groupItemInfo->fileOffset;
   if (fileSize) *fileSize = groupItemInfo->fileSize;
   return getOffset(data, offset);
 }
 
-void* SoundArchive::getInternalWaveData(u32 fileIdx) const {
+const void* SoundArchive::getInternalWaveData(u32 fileIdx, size_t* fileSize) const {
+  const FileGroupInfo* fileGroupInfo = getFileGroupInfo(fileIdx);
+  if (!fileGroupInfo || fileGroupInfo->size == 0) return nullptr; // external file
   const FileGroup* fileGroup = getFileGroup(fileIdx, 0);
   const GroupInfo* groupInfo = getGroupInfo(fileGroup->groupIdx);
-  char* externalFileName = static_cast<char*>(groupInfo->externalFileName.getAddr(infoBase));
+  const char* externalFileName = groupInfo->externalFileName.getAddr<char>(infoBase);
   if (externalFileName) return nullptr; // file belongs to external group
 
   const GroupItemInfo* groupItemInfo = getGroupItemInfo(fileGroup->groupIdx, fileGroup->idx);
   u32 offset = groupInfo->waveDataOffset + groupItemInfo->waveDataOffset;
+  if (fileSize) *fileSize = groupItemInfo->waveDataSize;
   return getOffset(data, offset);
 }
 
-void* SoundArchive::getInternalWaveData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize) const {
+const void* SoundArchive::getInternalWaveData(const GroupInfo* groupInfo, const GroupItemInfo* groupItemInfo, size_t* fileSize) const {
   u32 offset = groupInfo->waveDataOffset + groupItemInfo->waveDataOffset;
   if (fileSize) *fileSize = groupItemInfo->waveDataSize;
   return getOffset(data, offset);
@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <unordered_map>
 
 #include "rsnd/SoundBank.hpp"
 
@@ -15,144 +16,45 @@ static int roundUp(int numToRound, int multiple) {
 }
 
 namespace rsnd {
-void SoundBankHeader::bswap() {
-  this->BinaryFileHeader::bswap();
-  dataOffset = std::byteswap(dataOffset);
-  dataLength = std::byteswap(dataLength);
-  waveOffset = std::byteswap(waveOffset);
-  waveLength = std::byteswap(waveLength);
-}
-
-void InstrInfo::bswap() {
-  waveIdx = std::byteswap(waveIdx);
-  pitch = bswap_float(pitch);
-  lfoTable.bswap();
-  graphEnvTable.bswap();
-  randomizerTable.bswap();
-  _res = std::byteswap(_res);
-}
-
-void IndexRegion::bswap() {
-  _2 = std::byteswap(_2);
-  for (int i = 0; i < max - min; i++) {
-    regionRefs[i].bswap();
-  }
-}
-
-void SoundBankData::bswap() {
-  this->BinaryBlockHeader::bswap();
-  instrs.bswap();
-}
-
-void SoundBankWave::bswap() {
-  this->BinaryBlockHeader::bswap();
-  waveInfos.bswap();
-}
-
-SoundBank::SoundBank(void* fileData, size_t fileSize, void* waveData) {
+SoundBank::SoundBank(const void* fileData, size_t fileSize) {
   dataSize = fileSize;
   data = fileData;
 
-  SoundBankHeader* bnkHdr = static_cast<SoundBankHeader*>(fileData);
-  bool falseEndian = bnkHdr->byteOrder != 0xFEFF;
-  if (falseEndian) bnkHdr->bswap();
-
+  const SoundBankHeader* bnkHdr = static_cast<const SoundBankHeader*>(fileData);
   bankData = getOffsetT<SoundBankData>(data, bnkHdr->dataOffset);
-  if (falseEndian) bankData->bswap();
   dataBase = getOffset(bankData, sizeof(BinaryBlockHeader));
 
   containsWaves = bnkHdr->waveOffset != 0;
   if (containsWaves) {
     bankWave = getOffsetT<SoundBankWave>(data, bnkHdr->waveOffset);
-    if (falseEndian) bankWave->bswap();
     waveBase = getOffset(bankWave, sizeof(BinaryBlockHeader));
-
-    for (int i = 0; i < bankWave->waveInfos.size; i++) {
-      WaveInfo* waveInfo = bankWave->waveInfos.elems[i].getAddr<WaveInfo>(waveBase);
-      if (falseEndian) waveInfo->bswap();
-      waveInfo->loopStart = sampleByDspAddress(waveInfo->loopStart, waveInfo->format);
-      waveInfo->loopEnd = sampleByDspAddress(waveInfo->loopEnd, waveInfo->format) + 1;
-
-      u32* channelInfoOffsets = getOffsetT<u32>(waveInfo, waveInfo->channelInfoTableOffset);
-      for (int j = 0; j < waveInfo->channelCount; j++) {
-        if (falseEndian) channelInfoOffsets[j] = std::byteswap(channelInfoOffsets[j]);
-        SoundWaveChannelInfo* chInfo = getOffsetT<SoundWaveChannelInfo>(waveInfo, channelInfoOffsets[j]);
-        if (falseEndian) chInfo->bswap();
-
-        if (waveInfo->format == WaveInfo::FORMAT_ADPCM) {
-          AdpcParams* adpcParams = getOffsetT<AdpcParams>(waveInfo, chInfo->adpcmOffset);
-          if (falseEndian) adpcParams->bswap();
-        }
-
-        if (falseEndian && waveInfo->format == WaveInfo::FORMAT_PCM16 && waveData != nullptr) {
-          // audio samples also need byteswap in this case
-          s16* blockData = reinterpret_cast<s16*>((u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset);
-          u32 sampleCount = waveInfo->loopEnd;
-          for (int sample = 0; sample < sampleCount; sample++) {
-            blockData[sample] = std::byteswap(blockData[sample]);
-          }
-        }
-      }
-    }
   } else {
     bankWave = nullptr;
   }
-
-  // Each instrument has a region for note and a subregion for velocity
-  // i is the index of the instrument. Regions are followed according to chosen key+velocity to get to InstrInfo
-  for (int i = 0; i < bankData->instrs.size; i++) {
-    auto& regionRef = bankData->instrs.elems[i];
-    bswapRegionsRecurse(regionRef);
-  }
 }
 
-void SoundBank::bswapRegionsRecurse(DataRef& regionRef) {
-  RegionSet regionType = static_cast<RegionSet>(regionRef.dataType);
-  switch (regionType) {
-  case REGIONSET_RANGE: {
-    RangeTable* rangeTable = regionRef.getAddr<RangeTable>(dataBase);
-    rangeTable->bswap();
-    for (int i = 0; i < rangeTable->rangeCount; i++) {
-      DataRef* dataRef = getSubregionRef(&regionRef, rangeTable->key[i]);
-      dataRef->bswap();
-      bswapRegionsRecurse(*dataRef);
-    }
-    break;
-  } case REGIONSET_INDEX: {
-    IndexRegion* indexRegion = regionRef.getAddr<IndexRegion>(dataBase);
-    indexRegion->bswap();
-    for (int i = indexRegion->min; i < indexRegion->max; i++) {
-      bswapRegionsRecurse(*getSubregionRef(&regionRef, i));
-    }
-    break;
-  } case REGIONSET_DIRECT: {
-    InstrInfo* instrInfo = regionRef.getAddr<InstrInfo>(dataBase);
-    instrInfo->bswap();
-    break;
-  } case REGIONSET_NONE: {
-    break;
-  } default:
-    //std::cerr << "Warning: unknown subregion reference " << regionType << '\n';
-    break;
-  }
+SoundBank::~SoundBank() {
+  delete regionLookup.load();
 }
 
-DataRef* SoundBank::getSubregionRef(const DataRef* ref, int idx) const {
+const DataRef* SoundBank::getSubregionRef(const DataRef* ref, int idx) const {
   RegionSet regionType = static_cast<RegionSet>(ref->dataType);
   switch (regionType) {
   case REGIONSET_RANGE: {
-    RangeTable* rangeTable = ref->getAddr<RangeTable>(dataBase);
+    const RangeTable* rangeTable = ref->getAddr<RangeTable>(dataBase);
     u8 i = 0;
-    while (idx > rangeTable->key[i]) {
+    while (i < rangeTable->rangeCount && idx > rangeTable->key[i]) {
       i++;
     }
+    if (i == rangeTable->rangeCount) return nullptr;
     int offset = roundUp(sizeof(rangeTable->rangeCount) + rangeTable->rangeCount, 4) + sizeof(DataRef) * i;
     return getOffsetT<DataRef>(rangeTable, offset);
   } case REGIONSET_INDEX: {
-    IndexRegion* indexRegion = ref->getAddr<IndexRegion>(dataBase);
+    const IndexRegion* indexRegion = ref->getAddr<IndexRegion>(dataBase);
+    if (idx < indexRegion->min || idx > indexRegion->max) return nullptr;
     return &indexRegion->regionRefs[idx - indexRegion->min];
   } case REGIONSET_DIRECT: {
-    return const_cast<DataRef*>(ref);
+    return ref;
   } case REGIONSET_NONE: {
     return nullptr;
   } default:
@@ -162,47 +64,90 @@ DataRef* SoundBank::getSubregionRef(const DataRef* ref, int idx) const {
   return nullptr;
 }
 
-InstrInfo* SoundBank::getInstrInfo(int progIdx, int key, int velocity) {
-  // programs -> keys -> velocities
-  DataRef* ref = &bankData->instrs.elems[progIdx];
-
-  if (ref->dataType == REGIONSET_NONE) return nullptr;
-  if (ref->dataType != REGIONSET_DIRECT) {
-    ref = getSubregionRef(ref, key);
+const SoundBank::RegionLookup* SoundBank::buildRegionLookup() const {
+  RegionLookup* lookup = new RegionLookup;
+  const u32 programCount = getInstrCount();
+  lookup->keyZones.resize(programCount * 128, 0);
+  lookup->zones.resize(128, nullptr);
+
+  // key regions, each one becomes a zone holding its velocity regions
+  std::unordered_map<const DataRef*, u32> zoneByRef;
+  for (u32 program = 0; program < programCount; program++) {
+    // programs -> keys -> velocities, a direct reference on the way covers everything below it
+    const DataRef* programRef = &bankData->instrs.elems[program];
+    for (int key = 0; key < 128; key++) {
+      const DataRef* keyRef = programRef->dataType == REGIONSET_DIRECT ? programRef : getSubregionRef(programRef, key);
+      if (!keyRef || keyRef->dataType == REGIONSET_NONE) continue;
+
+      auto [zone, inserted] = zoneByRef.try_emplace(keyRef, lookup->zones.size() / 128);
+      if (inserted) {
+        lookup->zones.resize(lookup->zones.size() + 128, nullptr);
+        for (int velocity = 0; velocity < 128; velocity++) {
+          const DataRef* velocityRef = keyRef->dataType == REGIONSET_DIRECT ? keyRef : getSubregionRef(keyRef, velocity);
+          if (!velocityRef || velocityRef->dataType != REGIONSET_DIRECT) continue;
+          lookup->zones[zone->second * 128 + velocity] = velocityRef->getAddr<InstrInfo>(dataBase);
+        }
+      }
+      lookup->keyZones[program * 128 + key] = zone->second;
+    }
   }
+  return lookup;
+}
 
-  if (ref->dataType == REGIONSET_NONE) return nullptr;
-  if (ref->dataType != REGIONSET_DIRECT) {
-    ref = getSubregionRef(ref, velocity);
-  }
+const SoundBank::RegionLookup* SoundBank::getRegionLookup() const {
+  const RegionLookup* cached = regionLookup.load(std::memory_order_acquire);
+  if (cached) return cached;
+  const RegionLookup* built = buildRegionLookup();
+  if (regionLookup.compare_exchange_strong(cached, built, std::memory_order_acq_rel)) return built;
+  // built concurrently by another thread
+  delete built;
+  return cached;
+}
 
-  return ref->getAddr<InstrInfo>(dataBase);
+const InstrInfo* SoundBank::getInstrInfo(int progIdx, int key, int velocity) const {
+  if (progIdx < 0 || static_cast<u32>(progIdx) >= getInstrCount() || key < 0 || key > 127 || velocity < 0 || velocity > 127) return nullptr;
+  const RegionLookup* lookup = getRegionLookup();
+  return lookup->zones[lookup->keyZones[progIdx * 128 + key] * 128 + velocity];
+}
+
+void SoundBank::resolve(std::span<NoteQuery> queries) const {
+  const RegionLookup* lookup = getRegionLookup();
+  const u32 programCount = getInstrCount();
+  for (NoteQuery& query : queries) {
+    if (query.program >= programCount || query.key > 127 || query.velocity > 127) {
+      query.instrInfo = nullptr;
+      continue;
+    }
+    query.instrInfo = lookup->zones[lookup->keyZones[query.program * 128 + query.key] * 128 + query.velocity];
+  }
 }
 
 std::vector<SoundBank::Subregion> SoundBank::getSubregions(const DataRef* regionRef) const {
   RegionSet regionType = static_cast<RegionSet>(regionRef->dataType);
   switch (regionType) {
   case REGIONSET_RANGE: {
-    RangeTable* rangeTable = regionRef->getAddr<RangeTable>(dataBase);
+    const RangeTable* rangeTable = regionRef->getAddr<RangeTable>(dataBase);
     std::vector<SoundBank::Subregion> subregions;
     for (int i = 0; i < rangeTable->rangeCount; i++) {
-      DataRef* dataRef = getSubregionRef(regionRef, rangeTable->key[i]);
-      Subregion region = {rangeTable->key[i], dataRef};
+      const DataRef* dataRef = getSubregionRef(regionRef, rangeTable->key[i]);
+      s16 low = i > 0 ? rangeTable->key[i - 1] + 1 : 0;
+      Subregion region = {low, rangeTable->key[i], dataRef};
       subregions.push_back(region);
     }
     return subregions;
   } case REGIONSET_INDEX: {
-    IndexRegion* indexRegion = regionRef->getAddr<IndexRegion>(dataBase);
+    const IndexRegion* indexRegion = regionRef->getAddr<IndexRegion>(dataBase);
     std::vector<SoundBank::Subregion> subregions;
-    for (u8 i = indexRegion->min; i < indexRegion->max; i++) {
-      DataRef* dataRef = getSubregionRef(regionRef, i);
-      Subregion region = {i, dataRef};
+    // one entry per index in [min, max], indices outside it play nothing
+    for (int i = indexRegion->min; i <= indexRegion->max; i++) {
+      const DataRef* dataRef = getSubregionRef(regionRef, i);
+      Subregion region = {static_cast<s16>(i), static_cast<s16>(i), dataRef};
       subregions.push_back(region);
     }
     return subregions;
   } case REGIONSET_DIRECT: {
-    InstrInfo* instrInfo = regionRef->getAddr<InstrInfo>(dataBase);
-    return { { 0x7F, regionRef } };
+    const InstrInfo* instrInfo = regionRef->getAddr<InstrInfo>(dataBase);
+    return { { 0, 0x7F, regionRef } };
   } case REGIONSET_NONE: {
     return {};
   } default:
@@ -213,20 +158,21 @@ std::vector<SoundBank::Subregion> SoundBank::getSubregions(const DataRef* region
 
 std::vector<SoundBank::InstrumentRegion> SoundBank::getInstrRegions(int progIdx) const {
   std::vector<SoundBank::InstrumentRegion> instrRegions;
-  DataRef* ref = &bankData->instrs.elems[progIdx];
+  const DataRef* ref = &bankData->instrs.elems[progIdx];
 
   // key ranges
   std::vector<SoundBank::Subregion> keyRegions = getSubregions(ref);
   for (int i = 0; i < keyRegions.size(); i++) {
-    u8 keyLo = (i > 0) ? keyRegions[i - 1].high + 1 : 0;
+    u8 keyLo = keyRegions[i].low;
     u8 keyHi = keyRegions[i].high;
 
     // velocity ranges
     std::vector<SoundBank::Subregion> velRegions = getSubregions(keyRegions[i].ref);
     for (int j = 0; j < velRegions.size(); j++) {
-      u8 velLo = (j > 0) ? velRegions[j - 1].high + 1 : 0;
+      if (velRegions[j].ref->dataType != REGIONSET_DIRECT) continue;
+      u8 velLo = velRegions[j].low;
       u8 velHi = velRegions[j].high;
-      InstrInfo* instrInfo = velRegions[j].ref->getAddr<InstrInfo>(dataBase);
+      const InstrInfo* instrInfo = velRegions[j].ref->getAddr<InstrInfo>(dataBase);
 
       InstrumentRegion instrRegion;
       instrRegion.keyLo = keyLo;
@@ -240,4 +186,5 @@ std::vector<SoundBank::InstrumentRegion> SoundBank::getInstrRegions(int progIdx)
 
   return instrRegions;
 }
+
 }
@@ -1,156 +1,82 @@
 
-#include <bit>
-#include <concepts>
 #include <array>
 #include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <vector>
 
 #include "rsnd/SoundStream.hpp"
+#include "rsnd/SoundStreamReader.hpp"
 #include "rsnd/soundCommon.hpp"
 #include "common/fileUtil.hpp"
+#include "common/threadPool.hpp"
 
 namespace rsnd {
-void SoundStreamHeader::bswap() {
-  this->BinaryFileHeader::bswap();
-  headOffset = std::byteswap(headOffset);
-  headSize = std::byteswap(headSize);
-  adpcOffset = std::byteswap(adpcOffset);
-  adpcSize = std::byteswap(adpcSize);
-  dataOffset = std::byteswap(dataOffset);
-  dataSize = std::byteswap(dataSize);
-}
-
-void SoundStreamHead::bswap() {
-  this->BinaryBlockHeader::bswap();
-  streamDataInfo.bswap();
-  trackTable.bswap();
-  channelTable.bswap();
-};
-
-void AdpcEntry::bswap() {
-  yn1 = std::byteswap(yn1);
-  yn2 = std::byteswap(yn2);
-}
-
-void SoundStreamAdpc::bswap() {
-  this->BinaryBlockHeader::bswap();
-  u16* adpcData = reinterpret_cast<u16*>((u8*)this + sizeof(BinaryBlockHeader));
-  while (adpcData < reinterpret_cast<u16*>((u8*)this + length)) {
-    *adpcData = std::byteswap(*adpcData);
-    adpcData++;
-  }
-}
-
-void SoundStreamData::bswap() {
-  this->BinaryBlockHeader::bswap();
-  dataOffset = std::byteswap(dataOffset);
-}
-
-void StreamDataInfo::bswap() {
-  sampleRate = std::byteswap(sampleRate);
-  loopStart = std::byteswap(loopStart);
-  loopEnd = std::byteswap(loopEnd);
-  dataOffset = std::byteswap(dataOffset);
-  blockCount = std::byteswap(blockCount);
-  blockSize = std::byteswap(blockSize);
-  blockSamples = std::byteswap(blockSamples);
-  finalBlockSize = std::byteswap(finalBlockSize);
-  finalBlockSamples = std::byteswap(finalBlockSamples);
-  finalBlockPaddedSize = std::byteswap(finalBlockPaddedSize);
-  adpcmInterval = std::byteswap(adpcmInterval);
-  adpcmDataSize = std::byteswap(adpcmDataSize);
-}
-
-void TrackTable::bswap() {
-  for (int i = 0; i < trackCount; i++) {
-    trackInfo[i].bswap();
-  }
-}
-
-void ChannelTable::bswap() {
-  for (int i = 0; i < channelCount; i++) {
-    channelInfo[i].bswap();
-  }
-}
-
-void ChannelInfo::bswap() {
-  adpcParams.bswap();
-}
-
-SoundStream::SoundStream(void* fileData, size_t fileSize) {
+SoundStream::SoundStream(const void* fileData, size_t fileSize) {
   dataSize = fileSize;
   data = fileData;
 
-  SoundStreamHeader* strmHdr = static_cast<SoundStreamHeader*>(data);
-  strmHdr->bswap();
-  strmHead = reinterpret_cast<SoundStreamHead*>((u8*)data + strmHdr->headOffset);
-  strmHead->bswap();
-  strmData = reinterpret_cast<SoundStreamData*>((u8*)data + strmHdr->dataOffset);
-  strmData->bswap();
+  const SoundStreamHeader* strmHdr = static_cast<const SoundStreamHeader*>(data);
+  strmHead = getOffsetT<SoundStreamHead>(data, strmHdr->headOffset);
+  strmData = getOffsetT<SoundStreamData>(data, strmHdr->dataOffset);
   if (strmHdr->adpcSize > 0) {
-    strmAdpc = reinterpret_cast<SoundStreamAdpc*>((u8*)data + strmHdr->adpcOffset);
-    strmAdpc->bswap();
+    strmAdpc = getOffsetT<SoundStreamAdpc>(data, strmHdr->adpcOffset);
   } else {
     strmAdpc = nullptr;
   }
 
-  strmDataInfo = reinterpret_cast<StreamDataInfo*>(strmHead->streamDataInfo.getAddr((u8*)strmHead + 8));
-  strmDataInfo->bswap();
-
-  trackTable = reinterpret_cast<TrackTable*>(strmHead->trackTable.getAddr((u8*)strmHead + 8));
-  trackTable->bswap();
-  for (int i = 0; i < trackTable->trackCount; i++) {
-    TrackInfoExtended* trackInfo = reinterpret_cast<TrackInfoExtended*>(trackTable->trackInfo[i].getAddr((u8*)strmHead + 8));
-    trackInfo->bswap();
-  }
-
-  channelTable = reinterpret_cast<ChannelTable*>(strmHead->channelTable.getAddr((u8*)strmHead + 8));
-  channelTable->bswap();
-  for (int i = 0; i < channelTable->channelCount; i++) {
-    ChannelInfo* channelInfo = reinterpret_cast<ChannelInfo*>(channelTable->channelInfo[i].getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
-    channelInfo->bswap();
-    AdpcParams* adpcParams = reinterpret_cast<AdpcParams*>(channelInfo->adpcParams.getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
-    adpcParams->bswap();
-  }
-
-  if (strmDataInfo->format == StreamDataInfo::FORMAT_PCM16) {
-    for (int c = 0; c < strmDataInfo->channelCount; c++) {
-      for (int b = 0; b < strmDataInfo->blockCount; b++) {
-        s16* blockData = reinterpret_cast<s16*>(const_cast<u8*>(getBlockData(c, b)));
-        u32 blockSamples = b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockSamples : strmDataInfo->blockSamples;
-        for (int i = 0; i < blockSamples; i++) {
-          blockData[i] = std::byteswap(blockData[i]);
-        }
+  const void* headBase = getOffset(strmHead, sizeof(BinaryBlockHeader));
+  strmDataInfo = strmHead->streamDataInfo.getAddr<StreamDataInfo>(headBase);
+  trackTable = strmHead->trackTable.getAddr<TrackTable>(headBase);
+  channelTable = strmHead->channelTable.getAddr<ChannelTable>(headBase);
+
+  format = strmDataInfo->format;
+  streamChannelCount = strmDataInfo->channelCount;
+  blockCount = strmDataInfo->blockCount;
+  blockSamples = strmDataInfo->blockSamples;
+  finalBlockSamples = strmDataInfo->finalBlockSamples;
+
+  // resolve every block once, the decoders then only index this table
+  blockTable.resize(static_cast<size_t>(blockCount) * streamChannelCount);
+  for (u8 c = 0; c < streamChannelCount; c++) {
+    const be<s16>* coeffs = format == StreamDataInfo::FORMAT_ADPCM ? getAdpcParams(c)->params.coeffs : nullptr;
+    for (u32 b = 0; b < blockCount; b++) {
+      ChannelData& channel = blockTable[static_cast<size_t>(b) * streamChannelCount + c];
+      channel = { getBlockData(c, b), coeffs, 0, 0 };
+      // every block starts from its own history, so blocks decode independently of each other
+      if (coeffs && strmAdpc) {
+        const AdpcEntry* adpcEntry = getAdpcEntry(b, c);
+        channel.yn1 = adpcEntry->yn1;
+        channel.yn2 = adpcEntry->yn2;
       }
     }
   }
 }
 
 const TrackInfoSimple* SoundStream::getTrackInfoSimple(u8 idx) const {
-  return reinterpret_cast<TrackInfoSimple*>(trackTable->trackInfo[idx].getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
+  return trackTable->trackInfo[idx].getAddr<TrackInfoSimple>(getOffset(strmHead, sizeof(BinaryBlockHeader)));
 }
 
 const TrackInfoExtended* SoundStream::getTrackInfoExtended(u8 idx) const {
-  return reinterpret_cast<TrackInfoExtended*>(trackTable->trackInfo[idx].getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
+  return trackTable->trackInfo[idx].getAddr<TrackInfoExtended>(getOffset(strmHead, sizeof(BinaryBlockHeader)));
 }
 
 const ChannelInfo* SoundStream::getChannelInfo(u8 idx) const {
-  return reinterpret_cast<ChannelInfo*>(channelTable->channelInfo[idx].getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
+  return channelTable->channelInfo[idx].getAddr<ChannelInfo>(getOffset(strmHead, sizeof(BinaryBlockHeader)));
 }
 
 const AdpcParams* SoundStream::getAdpcParams(u8 channelIdx) const {
   const ChannelInfo* chInfo = getChannelInfo(channelIdx);
-  return reinterpret_cast<AdpcParams*>(chInfo->adpcParams.getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
+  return chInfo->adpcParams.getAddr<AdpcParams>(getOffset(strmHead, sizeof(BinaryBlockHeader)));
 }
 
 const AdpcEntry* SoundStream::getAdpcEntry(u32 b, u8 c) const {
-  return reinterpret_cast<AdpcEntry*>((u8*)strmAdpc + sizeof(BinaryBlockHeader) + (b * strmDataInfo->channelCount + c) * sizeof(AdpcEntry));
+  return getOffsetT<AdpcEntry>(strmAdpc, sizeof(BinaryBlockHeader) + (b * strmDataInfo->channelCount + c) * sizeof(AdpcEntry));
 }
 
 const u32 SoundStream::getSampleCount() const {
-  return (strmDataInfo->blockCount - 1) * strmDataInfo->blockSamples + strmDataInfo->finalBlockSamples;
+  return (blockCount - 1) * blockSamples + finalBlockSamples;
 }
 
 const u8* SoundStream::getBlockData(u8 channelIdx, u32 blockIdx) const {
@@ -171,131 +97,160 @@ const u8* SoundStream::getBlockData(u8 channelIdx, u32 blockIdx) const {
     b + 1 == blockCount
       ? rawDataOffset + finalBlockSize
       : rawDataOffset + blockSize;
-  return reinterpret_cast<u8*>(strmData) + sizeof(BinaryBlockHeader) + strmData->dataOffset + rawDataOffset;
+  return getOffsetT<u8>(strmData, sizeof(BinaryBlockHeader) + strmData->dataOffset + rawDataOffset);
 }
 
-void SoundStream::decodeChannelPcm8(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
-  u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
-
-  for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const u8* blockData = getBlockData(channelIdx, b);
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
+void SoundStream::decodeBlock(u8 channelIdx, u32 blockIdx, s16* buffer, u8 offset, u8 sampleStride) const {
+  s16* blockBuffer = buffer + static_cast<size_t>(blockIdx) * blockSamples * sampleStride + offset;
+  ChannelData channel = getBlockChannel(channelIdx, blockIdx);
+  decodeInterleaved(format, &channel, 1, getBlockSamples(blockIdx), blockBuffer, sampleStride);
+}
 
-    s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodePcm8Block(blockData, blockSamples, blockBuffer, sampleStride);
+void SoundStream::decodeBlockChannels(u32 blockIdx, const u8* channelIndices, u8 channelCount, s16* buffer) const {
+  // decode the block's channels together so they can share SIMD registers
+  std::vector<ChannelData> channels(channelCount);
+  for (u8 i = 0; i < channelCount; i++) {
+    channels[i] = getBlockChannel(channelIndices[i], blockIdx);
   }
+  decodeInterleaved(format, channels.data(), channelCount, getBlockSamples(blockIdx), buffer, channelCount);
 }
 
-void SoundStream::decodeChannelPcm16(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
-  u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
-
-  for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const u8* blockData = getBlockData(channelIdx, b);
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
-
-    s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodePcm16Block(blockData, blockSamples, blockBuffer, sampleStride);
+bool SoundStream::checkFormat() const {
+  switch (format)
+  {
+  case StreamDataInfo::FORMAT_PCM16:
+  case StreamDataInfo::FORMAT_PCM8:
+  case StreamDataInfo::FORMAT_ADPCM:
+    return true;
+  
+  default:
+    std::cerr << "Warning: unknown track format " << format << '\n';
+    return false;
   }
 }
 
-void SoundStream::decodeChannelAdpcm(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u8 c = channelIdx;
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
-  u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
+void SoundStream::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
+  if (!checkFormat()) return;
+  for (u32 b = 0; b < blockCount; b++) {
+    decodeBlock(channelIdx, b, buffer, offset, sampleStride);
+  }
+}
 
-  const AdpcParams* adpcParams = getAdpcParams(channelIdx);
+void SoundStream::decodeBlockRange(u32 blockIdx, const u8* channelIndices, u8 channelCount, u32 firstSample, u32 sampleCount, s16* buffer) const {
+  std::vector<ChannelData> channels(channelCount);
+  for (u8 i = 0; i < channelCount; i++) {
+    channels[i] = getBlockChannel(channelIndices[i], blockIdx);
+  }
+  decodeInterleavedRange(format, channels.data(), channelCount, firstSample, sampleCount, buffer);
+}
 
-  for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const AdpcEntry* adpcEntry = getAdpcEntry(b, c);
-    s16 yn1 = adpcEntry->yn1;
-    s16 yn2 = adpcEntry->yn2;
+u32 SoundStream::decodeRange(u8 trackIdx, u32 startSample, u32 sampleCount, s16* buffer) const {
+  u8 channelCount;
+  const u8* channelIndices = getTrackChannels(trackIdx, channelCount);
+  u32 totalSamples = getSampleCount();
+  if (!checkFormat() || startSample >= totalSamples) return 0;
+  sampleCount = std::min(sampleCount, totalSamples - startSample);
+  if (sampleCount == 0) return 0;
+
+  const u32 firstBlock = startSample / blockSamples;
+  const u32 lastBlock = (startSample + sampleCount - 1) / blockSamples;
+  getThreadPool().parallelFor(lastBlock - firstBlock + 1, [&](size_t i) {
+    u32 b = firstBlock + i;
+    u32 blockStart = b * blockSamples;
+    u32 first = std::max(startSample, blockStart);
+    u32 end = std::min(startSample + sampleCount, blockStart + getBlockSamples(b));
+    decodeBlockRange(b, channelIndices, channelCount, first - blockStart, end - first, buffer + static_cast<size_t>(first - startSample) * channelCount);
+  });
+  return sampleCount;
+}
 
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
-    const u8* blockData = getBlockData(c, b);
+u32 SoundStream::decodeLoopRange(u8 trackIdx, u32 loopOffset, u32 sampleCount, s16* buffer) const {
+  const u32 loopStart = getLoopStart();
+  const u32 loopBlock = loopStart / blockSamples;
+  const u32 blockOffset = loopStart % blockSamples;
+  if (format != StreamDataInfo::FORMAT_ADPCM || blockOffset % AX_ADPCM_SAMPLES_PER_FRAME != 0 || loopStart >= getSampleCount()) {
+    return decodeRange(trackIdx, loopStart + loopOffset, sampleCount, buffer);
+  }
 
-    s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodeAdpcmBlock(blockData, blockSamples, adpcParams->params.coeffs, yn1, yn2, blockBuffer, sampleStride);
+  // the loop context reaches to the end of the loop block, the following blocks start from their own history.
+  // A request starting inside that head still decodes it from the seam, so the result doesn't depend on how
+  // the caller splits the loop body
+  const u32 headSamples = getBlockSamples(loopBlock) - blockOffset;
+  u8 channelCount;
+  const u8* channelIndices = getTrackChannels(trackIdx, channelCount);
+  u32 written = 0;
+  if (loopOffset < headSamples) {
+    std::vector<ChannelData> channels(channelCount);
+    for (u8 i = 0; i < channelCount; i++) {
+      const AdpcmParamLoop& loopContext = getAdpcParams(channelIndices[i])->paramsLoop;
+      channels[i] = getBlockChannel(channelIndices[i], loopBlock);
+      channels[i].data += blockOffset / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE;
+      channels[i].yn1 = loopContext.yn1;
+      channels[i].yn2 = loopContext.yn2;
+    }
+    written = std::min(sampleCount, headSamples - loopOffset);
+    decodeInterleavedRange(format, channels.data(), channelCount, loopOffset, written, buffer);
+    if (written == sampleCount) return written;
   }
+  return written + decodeRange(trackIdx, loopStart + loopOffset + written, sampleCount - written, buffer + static_cast<size_t>(written) * channelCount);
 }
 
-void SoundStream::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  switch (strmDataInfo->format)
-  {
-  case StreamDataInfo::FORMAT_PCM16:
-    decodeChannelPcm16(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  case StreamDataInfo::FORMAT_PCM8:
-    decodeChannelPcm8(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  case StreamDataInfo::FORMAT_ADPCM:
-    decodeChannelAdpcm(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  default:
-    std::cerr << "Warning: unknown track format " << strmDataInfo->format << '\n';
-    break;
-  }
+void SoundStream::decodeChannels(const u8* channelIndices, u8 channelCount, s16* buffer) const {
+  if (!checkFormat()) return;
+  // (channel, block) pairs are independent. A job takes all channels of one block, so each
+  // thread fills a contiguous part of the interleaved buffer
+  getThreadPool().parallelFor(blockCount, [&](size_t b) {
+    decodeBlockChannels(b, channelIndices, channelCount, buffer + b * blockSamples * channelCount);
+  });
 }
 
 s16* SoundStream::getChannelPcm(u8 channelIdx) const {
   u32 sampleCount = getSampleCount();
   s16* pcmBuffer = static_cast<s16*>(malloc(sampleCount * sizeof(s16)));
-  decodeChannel(channelIdx, pcmBuffer);
+  decodeChannels(&channelIdx, 1, pcmBuffer);
 
   return pcmBuffer;
 }
 
-s16* SoundStream::getTrackPcm(u8 trackIdx, u8& channelCount) const {
-  const u8* channelIndices;
+const u8* SoundStream::getTrackChannels(u8 trackIdx, u8& channelCount) const {
   switch (trackTable->trackInfoType) {
   case TrackTable::SIMPLE: {
     const TrackInfoSimple* trackInfoSimple = getTrackInfoSimple(trackIdx);
     channelCount = trackInfoSimple->channelCount;
-    channelIndices = trackInfoSimple->channelIndices;
-    break;
+    return trackInfoSimple->channelIndices;
 
   } case TrackTable::EXTENDED: {
     const TrackInfoExtended* trackInfoExtended = getTrackInfoExtended(trackIdx);
     channelCount = trackInfoExtended->channelCount;
-    channelIndices = trackInfoExtended->channelIndices;
-    break;
+    return trackInfoExtended->channelIndices;
   
   } default:
     std::cout << "Invalid track info type value " << trackTable->trackInfoType << std::endl;
     exit(-1);
   }
+}
+
+s16* SoundStream::getTrackPcm(u8 trackIdx, u8& channelCount) const {
+  const u8* channelIndices = getTrackChannels(trackIdx, channelCount);
 
   u32 sampleCount = getSampleCount();
   s16* pcmBuffer = static_cast<s16*>(malloc(channelCount * sampleCount * sizeof(s16)));
 
-  for (int i = 0; i < channelCount; i++) {
-    u8 channelIdx = channelIndices[i];
-    decodeChannel(channelIdx, pcmBuffer, i, channelCount);
-  }
+  decodeChannels(channelIndices, channelCount, pcmBuffer);
 
   return pcmBuffer;
 }
 
 void SoundStream::trackToWaveFile(u8 trackIdx, std::filesystem::path wavePath) const {
-  u8 channelCount;
-  void* data = getTrackPcm(trackIdx, channelCount);
-  createWaveFile(wavePath, data, getSampleCount(), strmDataInfo->getSampleRate(), channelCount);
-  free(data);
+  SoundStreamReader reader(*this, trackIdx);
+  WaveWriter writer(wavePath, reader.getSampleRate(), reader.getChannelCount(), reader.getSampleCount());
+  if (!writer.isOpen()) return;
+
+  // a couple of blocks per thread keeps the pool busy, memory stays the same for any stream length
+  u32 bufferSamples = reader.getBlockSamples() * 2 * getThreadPool().getThreadCount();
+  std::vector<s16> buffer(static_cast<size_t>(bufferSamples) * reader.getChannelCount());
+  while (u32 samples = reader.read(buffer.data(), bufferSamples)) {
+    writer.write(buffer.data(), samples);
+  }
 }
 }
@@ -0,0 +1,36 @@
+#include <cassert>
+#include <iostream>
+
+#include "rsnd/SoundStreamReader.hpp"
+#include "common/threadPool.hpp"
+
+namespace rsnd {
+SoundStreamReader::SoundStreamReader(const SoundStream& stream, u8 trackIdx) : stream(stream), nextBlock(0) {
+  channelIndices = stream.getTrackChannels(trackIdx, channelCount);
+  // nothing to read from a stream we can't decode, decode warns once here instead of per block
+  if (!stream.checkFormat()) nextBlock = stream.getBlockCount();
+}
+
+u32 SoundStreamReader::read(s16* buffer, u32 maxSamples) {
+  const u32 blockCount = stream.getBlockCount();
+  const u32 blockSamples = stream.getFullBlockSamples();
+  // only whole blocks are decoded, a smaller buffer would never make progress
+  assert(nextBlock >= blockCount || maxSamples >= stream.getBlockSamples(nextBlock));
+  if (nextBlock < blockCount && maxSamples < stream.getBlockSamples(nextBlock)) {
+    std::cerr << "Warning: stream read of " << maxSamples << " samples is smaller than a block of " << stream.getBlockSamples(nextBlock) << ", nothing decoded\n";
+    return 0;
+  }
+
+  u32 firstBlock = nextBlock;
+  u32 samples = 0;
+  while (nextBlock < blockCount && samples + stream.getBlockSamples(nextBlock) <= maxSamples) {
+    samples += stream.getBlockSamples(nextBlock);
+    nextBlock++;
+  }
+
+  getThreadPool().parallelFor(nextBlock - firstBlock, [&](size_t i) {
+    stream.decodeBlockChannels(firstBlock + i, channelIndices, channelCount, buffer + i * blockSamples * channelCount);
+  });
+  return samples;
+}
+}
@@ -1,94 +1,57 @@
 
-#include <bit>
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 #include "rsnd/SoundWave.hpp"
 #include "common/fileUtil.hpp"
 
 namespace rsnd {
-void SoundWaveHeader::bswap() {
-  this->BinaryFileHeader::bswap();
-  infoOffset = std::byteswap(infoOffset);
-  infoLength = std::byteswap(infoLength);
-  dataOffset = std::byteswap(dataOffset);
-  dataLength = std::byteswap(dataLength);
-}
-
-void SoundWaveInfo::bswap() {
-  this->BinaryBlockHeader::bswap();
-  this->WaveInfo::bswap();
-}
-
-SoundWave::SoundWave(void* fileData, size_t fileSize) {
+SoundWave::SoundWave(const void* fileData, size_t fileSize) {
   dataSize = fileSize;
   data = fileData;
 
-  SoundWaveHeader* wavHdr = static_cast<SoundWaveHeader*>(fileData);
-  bool falseEndian = wavHdr->byteOrder != 0xFEFF;
-  if (falseEndian) wavHdr->bswap();
-
+  const SoundWaveHeader* wavHdr = static_cast<const SoundWaveHeader*>(fileData);
   info = getOffsetT<SoundWaveInfo>(data, wavHdr->infoOffset);
-  if (falseEndian) info->bswap();
-  info->loopStart = sampleByDspAddress(info->loopStart, info->format);
-  info->loopEnd = sampleByDspAddress(info->loopStart, info->format) + 1;
   infoBase = getOffset(info, sizeof(BinaryBlockHeader));
 
-  u32* channelInfoOffsets = getOffsetT<u32>(infoBase, info->channelInfoTableOffset);
-  for (int i = 0; i < info->channelCount; i++) {
-    if (falseEndian) channelInfoOffsets[i] = std::byteswap(channelInfoOffsets[i]);
-    SoundWaveChannelInfo* chInfo = getOffsetT<SoundWaveChannelInfo>(infoBase, channelInfoOffsets[i]);
-    if (falseEndian) chInfo->bswap();
-
-    if (info->format == WaveInfo::FORMAT_ADPCM) {
-      AdpcParams* adpcParams = getOffsetT<AdpcParams>(infoBase, chInfo->adpcmOffset);
-      if (falseEndian) adpcParams->bswap();
-    }
-  }
-
   waveData = getOffsetT<SoundWaveData>(data, wavHdr->dataOffset);
-  if (falseEndian) waveData->bswap();
   waveDataBase = getOffset(waveData, sizeof(BinaryBlockHeader));
+}
 
-  if (info->format == SoundWaveInfo::FORMAT_PCM16 && falseEndian) {
-    u32 sampleCount = getTrackSampleCount();
-    for (int i = 0; i < info->channelCount; i++) {
-      s16* blockData = reinterpret_cast<s16*>(const_cast<u8*>(getChannelData(i)));
-      for (int sample = 0; sample < sampleCount; sample++) {
-        blockData[sample] = std::byteswap(blockData[sample]);
-      }
-    }
-  }
+SoundWave::~SoundWave() {
+  delete seekTable.load();
 }
 
 u32 SoundWave::getTrackSampleCount() const {
   return sampleByDspAddress(waveData->length, info->format) / info->channelCount;
 }
 
+std::vector<ChannelData> SoundWave::getChannels() const {
+  std::vector<ChannelData> channels(info->channelCount);
+  for (int i = 0; i < info->channelCount; i++) {
+    channels[i] = ChannelData::make(getChannelData(i), info->format, getChannelAdpcmParam(i));
+  }
+  return channels;
+}
+
+const AdpcmSeekTable* SoundWave::getSeekTable() const {
+  if (info->format != SoundWaveInfo::FORMAT_ADPCM) return nullptr;
+  const AdpcmSeekTable* cached = seekTable.load(std::memory_order_acquire);
+  if (cached) return cached;
+
+  // threads racing here each build one, the loser throws its own away
+  const AdpcmSeekTable* built = new AdpcmSeekTable(getChannels().data(), info->channelCount, getTrackSampleCount());
+  if (seekTable.compare_exchange_strong(cached, built, std::memory_order_acq_rel)) return built;
+  delete built;
+  return cached;
+}
+
 void SoundWave::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 stride) const {
-  const u8* blockData = getChannelData(channelIdx);
-  u32 sampleCount = getTrackSampleCount();
   // decode as one large block
-  s16* blockBuffer = buffer + offset;
-
-  switch (info->format)
-  {
-  case SoundWaveInfo::FORMAT_PCM8:
-    decodePcm8Block(blockData, sampleCount, blockBuffer, stride);
-    break;
-  
-  case SoundWaveInfo::FORMAT_PCM16:
-    decodePcm16Block(blockData, sampleCount, blockBuffer, stride);
-    break;
-  
-  case SoundWaveInfo::FORMAT_ADPCM: {
-    const AdpcParams* adpcParams = getChannelAdpcmParam(channelIdx);
-    decodeAdpcmBlock(blockData, sampleCount, adpcParams->params.coeffs, adpcParams->params.yn1, adpcParams->params.yn2, blockBuffer, stride);
-    break;
-  
-  } default:
-    std::cerr << "Warning: unknown track format " << info->format << '\n';
-  }
+  ChannelData channel = ChannelData::make(getChannelData(channelIdx), info->format, getChannelAdpcmParam(channelIdx));
+  decodeInterleaved(info->format, &channel, 1, getTrackSampleCount(), buffer + offset, stride);
 }
 
 s16* SoundWave::getChannelPcm(u8 channelIdx) const {
@@ -99,15 +62,63 @@ s16* SoundWave::getChannelPcm(u8 channelIdx) const {
   return pcmBuffer;
 }
 
-s16* SoundWave::getTrackPcm() const {
+u32 SoundWave::decodeRange(u32 startSample, u32 sampleCount, s16* buffer) const {
+  std::vector<ChannelData> channels = getChannels();
+  if (const AdpcmSeekTable* table = getSeekTable()) {
+    return table->decodeRange(channels.data(), startSample, sampleCount, buffer);
+  }
+
+  u32 totalSamples = getTrackSampleCount();
+  if (startSample >= totalSamples) return 0;
+  sampleCount = std::min(sampleCount, totalSamples - startSample);
+  decodeInterleavedRange(info->format, channels.data(), channels.size(), startSample, sampleCount, buffer);
+  return sampleCount;
+}
+
+u32 SoundWave::decodeLoopRange(u32 loopOffset, u32 sampleCount, s16* buffer) const {
+  const u32 loopStart = getLoopStart();
+  const u32 totalSamples = getTrackSampleCount();
+  if (info->format != SoundWaveInfo::FORMAT_ADPCM || loopStart % AX_ADPCM_SAMPLES_PER_FRAME != 0 || loopStart >= totalSamples) {
+    return decodeRange(loopStart + loopOffset, sampleCount, buffer);
+  }
+
+  // the loop context reaches to the next seek table entry, which starts from the linear history again.
+  // A request starting inside that head still decodes it from the seam, so the result doesn't depend on
+  // how the caller splits the loop body
+  const u32 entrySamples = getSeekTable()->getEntrySamples();
+  const u32 headSamples = std::min(totalSamples, (loopStart / entrySamples + 1) * entrySamples) - loopStart;
+  u32 written = 0;
+  if (loopOffset < headSamples) {
+    std::vector<ChannelData> channels = getChannels();
+    for (u8 i = 0; i < info->channelCount; i++) {
+      const AdpcmParamLoop& loopContext = getChannelAdpcmParam(i)->paramsLoop;
+      channels[i].data += loopStart / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE;
+      channels[i].yn1 = loopContext.yn1;
+      channels[i].yn2 = loopContext.yn2;
+    }
+    written = std::min(sampleCount, headSamples - loopOffset);
+    decodeInterleavedRange(info->format, channels.data(), channels.size(), loopOffset, written, buffer);
+    if (written == sampleCount) return written;
+  }
+  return written + decodeRange(loopStart + loopOffset + written, sampleCount - written, buffer + static_cast<size_t>(written) * info->channelCount);
+}
+
+void SoundWave::decodeTrack(s16* buffer) const {
   u8 channelCount = info->channelCount;
   u32 sampleCount = getTrackSampleCount();
-  s16* pcmBuffer = static_cast<s16*>(malloc(channelCount * sampleCount * sizeof(s16)));
 
-  for (int i = 0; i < channelCount; i++) {
-    decodeChannel(i, pcmBuffer, i, channelCount);
+  std::vector<ChannelData> channels = getChannels();
+  if (hasSeekTable()) {
+    // already paid for, use it to decode the pieces in parallel
+    getSeekTable()->decodeRange(channels.data(), 0, sampleCount, buffer);
+  } else {
+    decodeInterleaved(info->format, channels.data(), channelCount, sampleCount, buffer, channelCount);
   }
+}
 
+s16* SoundWave::getTrackPcm() const {
+  s16* pcmBuffer = static_cast<s16*>(malloc(getTrackSampleBufferSize()));
+  decodeTrack(pcmBuffer);
   return pcmBuffer;
 }
 
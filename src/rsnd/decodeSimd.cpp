@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "rsnd/decodeSimd.hpp"
+#include "rsnd/soundCommon.hpp"
+
+// the kernels rely on GCC/Clang target attributes and __builtin_cpu_supports, other compilers get the scalar path
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define RSND_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rsnd {
+#ifdef RSND_SIMD_X86
+/**
+ * Channels are decoded side by side, one per 32 bit lane. Each lane keeps its history as an s16 pair
+ * (yn1 low, yn2 high) and the frame's coefficients as a matching pair, so a single madd computes
+ * c1 * yn1 + c2 * yn2 with the same 32 bit wraparound as the scalar code.
+ */
+struct AdpcmLaneFrame {
+  alignas(32) s32 coefPairs[8];
+  // 0x400 + ((scale * nibble) << 11) per sample and lane
+  alignas(32) s32 base[AX_ADPCM_SAMPLES_PER_FRAME][8];
+};
+
+static inline void prepareAdpcmLaneFrame(AdpcmLaneFrame& lanes, const ChannelData* channels, int laneCount, u32 frameIdx, u32 frameSamples) {
+  for (int l = 0; l < laneCount; l++) {
+    const u8* frame = channels[l].data + frameIdx * AX_ADPCM_FRAME_SIZE;
+    const u8 header = frame[0];
+    const int scale = static_cast<s16>(1 << (header & 0x0f));
+    const int predictor = header >> 4;
+    const u16 c1 = channels[l].coeffs[std::min(2 * predictor, 15)];
+    const u16 c2 = channels[l].coeffs[std::min(2 * predictor + 1, 15)];
+    lanes.coefPairs[l] = static_cast<s32>(c1 | (static_cast<u32>(c2) << 16));
+
+    for (u32 i = 0; i < frameSamples; i++) {
+      const s8 data = frame[1 + i / 2];
+      const int nibble = (i & 1) ? static_cast<s8>(data << 4) >> 4 : data >> 4;
+      lanes.base[i][l] = 0x400 + ((scale * nibble) << 11);
+    }
+  }
+}
+
+static inline s32 packHistory(s16 yn1, s16 yn2) {
+  return static_cast<s32>(static_cast<u16>(yn1) | (static_cast<u32>(static_cast<u16>(yn2)) << 16));
+}
+
+template<int N>
+__attribute__((target("sse4.1")))
+static void decodeAdpcmLanesSse(const ChannelData* channels, u32 sampleCount, s16* buffer, u32 stride) {
+  static_assert(N == 2 || N == 4);
+  alignas(16) s32 history[4] = {};
+  for (int l = 0; l < N; l++) history[l] = packHistory(channels[l].yn1, channels[l].yn2);
+
+  __m128i hist = _mm_load_si128(reinterpret_cast<const __m128i*>(history));
+  const __m128i lowMask = _mm_set1_epi32(0xffff);
+  const __m128i minSample = _mm_set1_epi32(-32768);
+  const __m128i maxSample = _mm_set1_epi32(32767);
+
+  AdpcmLaneFrame lanes = {};
+  s16* out = buffer;
+  for (u32 frameStart = 0, frameIdx = 0; frameStart < sampleCount; frameStart += AX_ADPCM_SAMPLES_PER_FRAME, frameIdx++) {
+    const u32 frameSamples = std::min<u32>(AX_ADPCM_SAMPLES_PER_FRAME, sampleCount - frameStart);
+    prepareAdpcmLaneFrame(lanes, channels, N, frameIdx, frameSamples);
+    const __m128i coefs = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.coefPairs));
+
+    for (u32 i = 0; i < frameSamples; i++) {
+      __m128i sample = _mm_add_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(lanes.base[i])), _mm_madd_epi16(hist, coefs));
+      sample = _mm_srai_epi32(sample, 11);
+      sample = _mm_min_epi32(_mm_max_epi32(sample, minSample), maxSample);
+      hist = _mm_or_si128(_mm_and_si128(sample, lowMask), _mm_slli_epi32(hist, 16));
+
+      const __m128i packed = _mm_packs_epi32(sample, sample);
+      if constexpr (N == 4) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), packed);
+      } else {
+        const s32 pair = _mm_cvtsi128_si32(packed);
+        memcpy(out, &pair, sizeof(pair));
+      }
+      out += stride;
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+static void decodeAdpcmLanesAvx2(const ChannelData* channels, u32 sampleCount, s16* buffer, u32 stride) {
+  alignas(32) s32 history[8];
+  for (int l = 0; l < 8; l++) history[l] = packHistory(channels[l].yn1, channels[l].yn2);
+
+  __m256i hist = _mm256_load_si256(reinterpret_cast<const __m256i*>(history));
+  const __m256i lowMask = _mm256_set1_epi32(0xffff);
+  const __m256i minSample = _mm256_set1_epi32(-32768);
+  const __m256i maxSample = _mm256_set1_epi32(32767);
+
+  AdpcmLaneFrame lanes;
+  s16* out = buffer;
+  for (u32 frameStart = 0, frameIdx = 0; frameStart < sampleCount; frameStart += AX_ADPCM_SAMPLES_PER_FRAME, frameIdx++) {
+    const u32 frameSamples = std::min<u32>(AX_ADPCM_SAMPLES_PER_FRAME, sampleCount - frameStart);
+    prepareAdpcmLaneFrame(lanes, channels, 8, frameIdx, frameSamples);
+    const __m256i coefs = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.coefPairs));
+
+    for (u32 i = 0; i < frameSamples; i++) {
+      __m256i sample = _mm256_add_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.base[i])), _mm256_madd_epi16(hist, coefs));
+      sample = _mm256_srai_epi32(sample, 11);
+      sample = _mm256_min_epi32(_mm256_max_epi32(sample, minSample), maxSample);
+      hist = _mm256_or_si256(_mm256_and_si256(sample, lowMask), _mm256_slli_epi32(hist, 16));
+
+      // packs works per 128 bit half, gather both halves' low qwords into the low 128 bits
+      const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sample, sample), 0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+      out += stride;
+    }
+  }
+}
+
+// PCM16 samples are big endian, swap the bytes of every 16 bit lane
+__attribute__((target("sse4.1")))
+static inline __m128i loadPcm16x8(const u8* data) {
+  const __m128i swapMask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), swapMask);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i loadPcm8x8(const u8* data) {
+  return _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i loadPcm16x16(const u8* data) {
+  const __m256i swapMask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  return _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), swapMask);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i loadPcm8x16(const u8* data) {
+  return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+}
+
+// contiguous output, returns how many samples were decoded; the caller finishes the tail
+template<bool PCM8>
+__attribute__((target("avx2")))
+static u32 decodePcmMonoAvx2(const u8* data, u32 sampleCount, s16* buffer) {
+  const u32 bytesPerSample = PCM8 ? 1 : 2;
+  u32 i = 0;
+  for (; i + 16 <= sampleCount; i += 16) {
+    const u8* src = data + i * bytesPerSample;
+    __m256i samples = PCM8 ? loadPcm8x16(src) : loadPcm16x16(src);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buffer + i), samples);
+  }
+  return i;
+}
+
+template<bool PCM8>
+__attribute__((target("sse4.1")))
+static u32 decodePcmMonoSse(const u8* data, u32 sampleCount, s16* buffer) {
+  const u32 bytesPerSample = PCM8 ? 1 : 2;
+  u32 i = 0;
+  for (; i + 8 <= sampleCount; i += 8) {
+    const u8* src = data + i * bytesPerSample;
+    __m128i samples = PCM8 ? loadPcm8x8(src) : loadPcm16x8(src);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + i), samples);
+  }
+  return i;
+}
+
+// two channels swapped/widened and interleaved in one pass. Same contract as decodePcmMono*
+template<bool PCM8>
+__attribute__((target("sse4.1")))
+static u32 decodePcmPairSse(const u8* left, const u8* right, u32 sampleCount, s16* buffer, u32 stride) {
+  const u32 bytesPerSample = PCM8 ? 1 : 2;
+  u32 i = 0;
+  for (; i + 8 <= sampleCount; i += 8) {
+    const u8* srcLeft = left + i * bytesPerSample;
+    const u8* srcRight = right + i * bytesPerSample;
+    __m128i l = PCM8 ? loadPcm8x8(srcLeft) : loadPcm16x8(srcLeft);
+    __m128i r = PCM8 ? loadPcm8x8(srcRight) : loadPcm16x8(srcRight);
+    __m128i lo = _mm_unpacklo_epi16(l, r);
+    __m128i hi = _mm_unpackhi_epi16(l, r);
+    if (stride == 2) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + i * 2), lo);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(buffer + i * 2 + 8), hi);
+    } else {
+      alignas(16) s32 pairs[8];
+      _mm_store_si128(reinterpret_cast<__m128i*>(pairs), lo);
+      _mm_store_si128(reinterpret_cast<__m128i*>(pairs + 4), hi);
+      for (int k = 0; k < 8; k++) memcpy(buffer + (i + k) * stride, &pairs[k], sizeof(s32));
+    }
+  }
+  return i;
+}
+
+template<bool PCM8>
+__attribute__((target("avx2")))
+static u32 decodePcmPairAvx2(const u8* left, const u8* right, u32 sampleCount, s16* buffer, u32 stride) {
+  // full width stores only pay off when the pair fills the whole output frame
+  if (stride != 2) return decodePcmPairSse<PCM8>(left, right, sampleCount, buffer, stride);
+
+  const u32 bytesPerSample = PCM8 ? 1 : 2;
+  u32 i = 0;
+  for (; i + 16 <= sampleCount; i += 16) {
+    const u8* srcLeft = left + i * bytesPerSample;
+    const u8* srcRight = right + i * bytesPerSample;
+    __m256i l = PCM8 ? loadPcm8x16(srcLeft) : loadPcm16x16(srcLeft);
+    __m256i r = PCM8 ? loadPcm8x16(srcRight) : loadPcm16x16(srcRight);
+    // unpack works per 128 bit half: lo = samples 0-3 | 8-11, hi = 4-7 | 12-15
+    __m256i lo = _mm256_unpacklo_epi16(l, r);
+    __m256i hi = _mm256_unpackhi_epi16(l, r);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buffer + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buffer + i * 2 + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  return i;
+}
+
+#endif
+
+typedef void (*AdpcmLanesFn)(const ChannelData* channels, u32 sampleCount, s16* buffer, u32 stride);
+// these return how many samples they decoded, the scalar code finishes the tail
+typedef u32 (*PcmMonoFn)(const u8* data, u32 sampleCount, s16* buffer);
+typedef u32 (*PcmPairFn)(const u8* left, const u8* right, u32 sampleCount, s16* buffer, u32 stride);
+
+// kernels of one SimdLevel, nullptr where the level has none
+struct DecodeKernels {
+  SimdLevel level;
+  AdpcmLanesFn adpcmLanes8;
+  AdpcmLanesFn adpcmLanes4;
+  AdpcmLanesFn adpcmLanes2;
+  PcmMonoFn pcm8Mono;
+  PcmMonoFn pcm16Mono;
+  PcmPairFn pcm8Pair;
+  PcmPairFn pcm16Pair;
+};
+
+static const DecodeKernels scalarKernels = {
+  SIMD_SCALAR,
+  nullptr, nullptr, nullptr,
+  nullptr, nullptr,
+  nullptr, nullptr,
+};
+#ifdef RSND_SIMD_X86
+static const DecodeKernels sse41Kernels = {
+  SIMD_SSE41,
+  nullptr, decodeAdpcmLanesSse<4>, decodeAdpcmLanesSse<2>,
+  decodePcmMonoSse<true>, decodePcmMonoSse<false>,
+  decodePcmPairSse<true>, decodePcmPairSse<false>,
+};
+static const DecodeKernels avx2Kernels = {
+  SIMD_AVX2,
+  decodeAdpcmLanesAvx2, decodeAdpcmLanesSse<4>, decodeAdpcmLanesSse<2>,
+  decodePcmMonoAvx2<true>, decodePcmMonoAvx2<false>,
+  decodePcmPairAvx2<true>, decodePcmPairAvx2<false>,
+};
+#endif
+
+static const DecodeKernels* kernelsFor(SimdLevel level) {
+  switch (level) {
+#ifdef RSND_SIMD_X86
+  case SIMD_AVX2:
+    return &avx2Kernels;
+  case SIMD_SSE41:
+    return &sse41Kernels;
+#endif
+  default:
+    return &scalarKernels;
+  }
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef RSND_SIMD_X86
+  if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+  return SIMD_SCALAR;
+}
+
+const char* getSimdLevelName(SimdLevel level) {
+  switch (level) {
+  case SIMD_AVX2:
+    return "avx2";
+  case SIMD_SSE41:
+    return "sse4.1";
+  default:
+    return "scalar";
+  }
+}
+
+bool parseSimdLevel(std::string_view name, SimdLevel& level) {
+  for (SimdLevel candidate : { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2 }) {
+    if (name == getSimdLevelName(candidate)) {
+      level = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::atomic<const DecodeKernels*> activeKernels(nullptr);
+
+void setSimdLevel(SimdLevel level) {
+  SimdLevel supported = detectSimdLevel();
+  if (level > supported) {
+    std::cerr << "Warning: CPU does not support " << getSimdLevelName(level) << ", using " << getSimdLevelName(supported) << '\n';
+    level = supported;
+  }
+  activeKernels = kernelsFor(level);
+}
+
+static const DecodeKernels& getKernels() {
+  const DecodeKernels* kernels = activeKernels;
+  if (kernels) return *kernels;
+
+  SimdLevel level = detectSimdLevel();
+  if (const char* forced = std::getenv("MRST_SIMD")) {
+    if (parseSimdLevel(forced, level)) {
+      setSimdLevel(level);
+      return *activeKernels;
+    }
+    std::cerr << "Warning: unknown MRST_SIMD value " << forced << '\n';
+  }
+  activeKernels = kernelsFor(level);
+  return *activeKernels;
+}
+
+SimdLevel getSimdLevel() {
+  return getKernels().level;
+}
+
+void decodeAdpcmChannels(const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride) {
+  const DecodeKernels& kernels = getKernels();
+  u32 c = 0;
+  if (kernels.adpcmLanes8) {
+    for (; channelCount - c >= 8; c += 8) kernels.adpcmLanes8(channels + c, sampleCount, buffer + c, stride);
+  }
+  if (kernels.adpcmLanes4) {
+    for (; channelCount - c >= 4; c += 4) kernels.adpcmLanes4(channels + c, sampleCount, buffer + c, stride);
+  }
+  if (kernels.adpcmLanes2) {
+    for (; channelCount - c >= 2; c += 2) kernels.adpcmLanes2(channels + c, sampleCount, buffer + c, stride);
+  }
+  for (; c < channelCount; c++) {
+    decodeAdpcmBlock(channels[c].data, sampleCount, channels[c].coeffs, channels[c].yn1, channels[c].yn2, buffer + c, stride);
+  }
+}
+
+static void decodePcmTail(const u8* data, u32 start, u32 sampleCount, s16* buffer, u32 stride, bool pcm8) {
+  if (start >= sampleCount) return;
+  if (pcm8) {
+    decodePcm8Block(data + start, sampleCount - start, buffer + start * stride, stride);
+  } else {
+    decodePcm16Block(data + start * 2, sampleCount - start, buffer + start * stride, stride);
+  }
+}
+
+void decodePcmChannels(const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride, u8 format) {
+  const DecodeKernels& kernels = getKernels();
+  const bool pcm8 = format == WaveInfo::FORMAT_PCM8;
+  const PcmPairFn pairKernel = pcm8 ? kernels.pcm8Pair : kernels.pcm16Pair;
+  const PcmMonoFn monoKernel = pcm8 ? kernels.pcm8Mono : kernels.pcm16Mono;
+  u32 c = 0;
+  if (pairKernel) {
+    for (; channelCount - c >= 2; c += 2) {
+      u32 done = pairKernel(channels[c].data, channels[c + 1].data, sampleCount, buffer + c, stride);
+      decodePcmTail(channels[c].data, done, sampleCount, buffer + c, stride, pcm8);
+      decodePcmTail(channels[c + 1].data, done, sampleCount, buffer + c + 1, stride, pcm8);
+    }
+  }
+  if (monoKernel && c < channelCount && stride == 1) {
+    u32 done = monoKernel(channels[c].data, sampleCount, buffer + c);
+    decodePcmTail(channels[c].data, done, sampleCount, buffer + c, stride, pcm8);
+    c++;
+  }
+  for (; c < channelCount; c++) {
+    decodePcmTail(channels[c].data, 0, sampleCount, buffer + c, stride, pcm8);
+  }
+}
+}
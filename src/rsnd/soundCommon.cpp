@@ -1,69 +1,130 @@
 
 #include <bit>
+#include <type_traits>
 #include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <vector>
 
 #include "rsnd/soundCommon.hpp"
 #include "common/util.h"
 
 namespace rsnd {
-void SoundWaveChannelInfo::bswap() {
-  dataOffset = std::byteswap(dataOffset);
-  adpcmOffset = std::byteswap(adpcmOffset);
-  frontLeftVolume = std::byteswap(frontLeftVolume);
-  frontRightVolume = std::byteswap(frontRightVolume);
-  backLeftVolume = std::byteswap(backLeftVolume);
-  backRightVolume = std::byteswap(backRightVolume);
-}
-
-void AdpcmParam::bswap() {
-  for (int i = 0; i < 16; i++) {
-    coeffs[i] = std::byteswap(coeffs[i]);
-  }
-  gain = std::byteswap(gain);
-  predictorScale = std::byteswap(predictorScale);
-  yn1 = std::byteswap(yn1);
-  yn2 = std::byteswap(yn2);
+u32 WaveInfo::getLoopStart() const {
+  return sampleByDspAddress(loopStart, format);
 }
 
-void AdpcmParamLoop::bswap() {
-  predictorScale = std::byteswap(predictorScale);
-  yn1 = std::byteswap(yn1);
-  yn2 = std::byteswap(yn2);
+u32 WaveInfo::getLoopEnd() const {
+  return sampleByDspAddress(loopEnd, format) + 1;
 }
 
-void AdpcParams::bswap() {
-  params.bswap();
-  paramsLoop.bswap();
+/**
+ * The scalar kernels are specialised on the output stride of the common layouts (mono, stereo, 5.1)
+ * so the index math folds into constants. STRIDE 0 takes the stride at runtime.
+ */
+template<typename Fn>
+static void withStride(u32 stride, Fn&& kernel) {
+  switch (stride) {
+  case 1:
+    kernel(std::integral_constant<u32, 1>());
+    break;
+  case 2:
+    kernel(std::integral_constant<u32, 2>());
+    break;
+  case 6:
+    kernel(std::integral_constant<u32, 6>());
+    break;
+  default:
+    kernel(std::integral_constant<u32, 0>());
+    break;
+  }
 }
 
-void WaveInfo::bswap() {
-  sampleRate = std::byteswap(sampleRate);
-  loopStart = std::byteswap(loopStart);
-  loopEnd = std::byteswap(loopEnd);
-  channelInfoTableOffset = std::byteswap(channelInfoTableOffset);
-  dataLoc = std::byteswap(dataLoc);
-  _18 = std::byteswap(_18);
+template<u32 STRIDE>
+static void decodePcm8Strided(const u8* blockData, u32 sampleCount, s16* buffer, u32 stride) {
+  const u32 outStride = STRIDE ? STRIDE : stride;
+  for (u32 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
+    buffer[sampleIndex * outStride] = (reinterpret_cast<const s8*>(blockData))[sampleIndex];
+  }
 }
 
-void decodePcm8Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride) {
+template<u32 STRIDE>
+static void decodePcm16Strided(const u8* blockData, u32 sampleCount, s16* buffer, u32 stride) {
+  const u32 outStride = STRIDE ? STRIDE : stride;
+  // samples are stored big endian
+  const be<s16>* samples = reinterpret_cast<const be<s16>*>(blockData);
   for (u32 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
-    buffer[sampleIndex * stride] = (reinterpret_cast<const s8*>(blockData))[sampleIndex];
+    buffer[sampleIndex * outStride] = samples[sampleIndex];
   }
 }
 
+void decodePcm8Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride) {
+  withStride(stride, [&](auto s) { decodePcm8Strided<decltype(s)::value>(blockData, sampleCount, buffer, stride); });
+}
+
 void decodePcm16Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride) {
-  if (stride == 1) {
-    memcpy(buffer, blockData, sampleCount * sizeof(s16));
-  } else {
-    for (u32 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
-      buffer[sampleIndex * stride] = (reinterpret_cast<const s16*>(blockData))[sampleIndex];
+  withStride(stride, [&](auto s) { decodePcm16Strided<decltype(s)::value>(blockData, sampleCount, buffer, stride); });
+}
+
+// one DSP-ADPCM sample. Same arithmetic as the reference implementation; the sum wraps at 32 bits
+// for out of range coefficients, done in u32 so the wraparound is defined
+static inline s16 decodeAdpcmSample(int nibble, int scale, int c1, int c2, int& hist1, int& hist2) {
+  int sample = static_cast<s32>(0x400u + (static_cast<u32>(scale * nibble) << 11) + static_cast<u32>(c1 * hist1) + static_cast<u32>(c2 * hist2)) >> 11;
+  sample = std::clamp(sample, -32768, 32767);
+  hist2 = hist1;
+  hist1 = sample;
+  return sample;
+}
+
+template<u32 STRIDE>
+static void decodeAdpcmStrided(const u8* blockData, u32 sampleCount, const be<s16> coeffsBe[16], s16 yn1, s16 yn2, s16* buffer, u32 stride) {
+  s16 coeffs[16];
+  for (int i = 0; i < 16; i++) coeffs[i] = coeffsBe[i];
+
+  int hist1 = yn1;
+  int hist2 = yn2;
+  const u8* frame = blockData;
+  s16* out = buffer;
+  const u32 outStride = STRIDE ? STRIDE : stride;
+
+  for (u32 remaining = sampleCount; remaining > 0; frame += AX_ADPCM_FRAME_SIZE) {
+    // header: predictor index in the high nibble, scale shift in the low one.
+    // The scale is an s16 (1 << 15 wraps) and indices past the table clamp to its last entry
+    const u8 header = frame[0];
+    const int scale = static_cast<s16>(1 << (header & 0x0f));
+    const int predictor = header >> 4;
+    const int c1 = coeffs[std::min(2 * predictor, 15)];
+    const int c2 = coeffs[std::min(2 * predictor + 1, 15)];
+
+    if (remaining >= AX_ADPCM_SAMPLES_PER_FRAME) {
+      for (int i = 0; i < AX_ADPCM_SAMPLE_BYTES_PER_FRAME; i++) {
+        const s8 data = frame[1 + i];
+        out[0] = decodeAdpcmSample(data >> 4, scale, c1, c2, hist1, hist2);
+        out[outStride] = decodeAdpcmSample(static_cast<s8>(data << 4) >> 4, scale, c1, c2, hist1, hist2);
+        out += 2 * outStride;
+      }
+      remaining -= AX_ADPCM_SAMPLES_PER_FRAME;
+    } else {
+      // partial final frame
+      for (u32 i = 0; i < remaining; i++) {
+        const s8 data = frame[1 + i / 2];
+        const int nibble = (i & 1) ? static_cast<s8>(data << 4) >> 4 : data >> 4;
+        *out = decodeAdpcmSample(nibble, scale, c1, c2, hist1, hist2);
+        out += outStride;
+      }
+      remaining = 0;
     }
   }
 }
 
-void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const s16 coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride) {
+void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const be<s16> coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride) {
+  withStride(stride, [&](auto s) { decodeAdpcmStrided<decltype(s)::value>(blockData, sampleCount, coeffs, yn1, yn2, buffer, stride); });
+}
+
+void decodeAdpcmBlockRef(const u8* blockData, u32 sampleCount, const be<s16> coeffsBe[16], s16 yn1, s16 yn2, s16* buffer, u8 stride) {
+    s16 coeffs[16];
+    for (int i = 0; i < 16; i++) coeffs[i] = coeffsBe[i];
+
     u8 cps;
     s16 cyn1 = yn1;
     s16 cyn2 = yn2;
@@ -86,10 +147,10 @@ void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const s16 coeffs[16]
       int cIndex = 2 * (cps >> 4);
 
       outSample =
-            (0x400 +
-              ((scale * outSample) << 11) +
-              coeffs[std::clamp(cIndex, 0, 15)] * cyn1 +
-              coeffs[std::clamp(cIndex + 1, 0, 15)] * cyn2) >>
+            static_cast<s32>(0x400u +
+              (static_cast<u32>(scale * outSample) << 11) +
+              static_cast<u32>(coeffs[std::clamp(cIndex, 0, 15)] * cyn1) +
+              static_cast<u32>(coeffs[std::clamp(cIndex + 1, 0, 15)] * cyn2)) >>
             11;
 
       cyn2 = cyn1;
@@ -99,19 +160,27 @@ void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const s16 coeffs[16]
     }
 }
 
-void decodeBlock(const u8* blockData, u32 sampleCount, s16* blockBuffer, u8 stride, u8 format, const AdpcParams* adpcParams) {
+std::vector<ChannelData> getWaveChannels(const WaveInfo* waveInfo, const void* waveData) {
+  const be<u32>* channelInfoOffsets = getOffsetT<be<u32>>(waveInfo, waveInfo->channelInfoTableOffset);
+  std::vector<ChannelData> channels(waveInfo->channelCount);
+  for (int j = 0; j < waveInfo->channelCount; j++) {
+    const SoundWaveChannelInfo* chInfo = getOffsetT<SoundWaveChannelInfo>(waveInfo, channelInfoOffsets[j]);
+    const u8* blockData = static_cast<const u8*>(waveData) + waveInfo->dataLoc + chInfo->dataOffset;
+    channels[j] = ChannelData::make(blockData, waveInfo->format, getOffsetT<AdpcParams>(waveInfo, chInfo->adpcmOffset));
+  }
+  return channels;
+}
+
+void decodeInterleaved(u8 format, const ChannelData* channels, u32 channelCount, u32 sampleCount, s16* buffer, u32 stride) {
   switch (format)
   {
   case WaveInfo::FORMAT_PCM8:
-    decodePcm8Block(blockData, sampleCount, blockBuffer, stride);
-    break;
-  
   case WaveInfo::FORMAT_PCM16:
-    decodePcm16Block(blockData, sampleCount, blockBuffer, stride);
+    decodePcmChannels(channels, channelCount, sampleCount, buffer, stride, format);
     break;
   
   case WaveInfo::FORMAT_ADPCM:
-    decodeAdpcmBlock(blockData, sampleCount, adpcParams->params.coeffs, adpcParams->params.yn1, adpcParams->params.yn2, blockBuffer, stride);
+    decodeAdpcmChannels(channels, channelCount, sampleCount, buffer, stride);
     break;
   
   default:
@@ -119,6 +188,39 @@ void decodeBlock(const u8* blockData, u32 sampleCount, s16* blockBuffer, u8 stri
   }
 }
 
+void decodeInterleavedRange(u8 format, const ChannelData* channels, u32 channelCount, u32 firstSample, u32 sampleCount, s16* buffer) {
+  switch (format)
+  {
+  case WaveInfo::FORMAT_PCM8:
+  case WaveInfo::FORMAT_PCM16: {
+    // PCM samples stand alone, start right at the first one
+    u32 bytesPerSample = format == WaveInfo::FORMAT_PCM8 ? 1 : 2;
+    std::vector<ChannelData> shifted(channels, channels + channelCount);
+    for (ChannelData& channel : shifted) channel.data += static_cast<size_t>(firstSample) * bytesPerSample;
+    decodeInterleaved(format, shifted.data(), channelCount, sampleCount, buffer, channelCount);
+    break;
+
+  } case WaveInfo::FORMAT_ADPCM: {
+    // the history is only known at the start, decode up to the range's end and drop the head
+    if (firstSample == 0) {
+      decodeInterleaved(format, channels, channelCount, sampleCount, buffer, channelCount);
+      break;
+    }
+    std::vector<s16> headBuffer(static_cast<size_t>(firstSample + sampleCount) * channelCount);
+    decodeInterleaved(format, channels, channelCount, firstSample + sampleCount, headBuffer.data(), channelCount);
+    memcpy(buffer, headBuffer.data() + static_cast<size_t>(firstSample) * channelCount, static_cast<size_t>(sampleCount) * channelCount * sizeof(s16));
+    break;
+
+  } default:
+    std::cerr << "Warning: unknown track format " << format << '\n';
+  }
+}
+
+void decodeBlock(const u8* blockData, u32 sampleCount, s16* blockBuffer, u8 stride, u8 format, const AdpcParams* adpcParams) {
+  ChannelData channel = ChannelData::make(blockData, format, adpcParams);
+  decodeInterleaved(format, &channel, 1, sampleCount, blockBuffer, stride);
+}
+
 static constexpr u32 BRSAR_MAGIC = MAGIC_FOURCC({'R', 'S', 'A', 'R'});
 static constexpr u32 BRSTM_MAGIC = MAGIC_FOURCC({'R', 'S', 'T', 'M'});
 static constexpr u32 BRWAV_MAGIC = MAGIC_FOURCC({'R', 'W', 'A', 'V'});
@@ -127,8 +229,8 @@ static constexpr u32 BRSEQ_MAGIC = MAGIC_FOURCC({'R', 'S', 'E', 'Q'});
 static constexpr u32 BRBNK_MAGIC = MAGIC_FOURCC({'R', 'B', 'N', 'K'});
 static constexpr u32 BRWSD_MAGIC = MAGIC_FOURCC({'R', 'W', 'S', 'D'});
 
-FileFormat detectFileFormat(const std::string& filename, void* fileData, size_t fileSize) {
-  u32 magic = *(u32*)fileData;
+FileFormat detectFileFormat(const std::string& filename, const void* fileData, size_t fileSize) {
+  u32 magic = *(const u32*)fileData;
   if (isFalseEndian(magic)) magic = std::byteswap(magic);
   if (magic == BRSAR_MAGIC) {
     return FMT_BRSAR;
@@ -149,16 +251,15 @@ FileFormat detectFileFormat(const std::string& filename, void* fileData, size_t
   }
 }
 
-u32 detectFileSize(void* fileData) {
-  auto* bfh = static_cast<BinaryFileHeader*>(fileData);
-  bool falseEndian = bfh->byteOrder != 0xFEFF;
-  return falseEndian ? std::byteswap(bfh->fileSize) : bfh->fileSize;
+u32 detectFileSize(const void* fileData) {
+  auto* bfh = static_cast<const BinaryFileHeader*>(fileData);
+  return bfh->fileSize;
 }
 
 
-std::string getFileFourcc(void* data) {
+std::string getFileFourcc(const void* data) {
   char magicStr[5];
-  u32 magic = *(u32*)data;
+  u32 magic = *(const u32*)data;
   *(u32*)magicStr = magic;
   magicStr[4] = '\0';
   return std::string(magicStr);
@@ -5,9 +5,31 @@
 #include "tools/common.hpp"
 
 namespace rsnd {
-std::string magicLowercase(void* fileData) {
+std::string magicLowercase(const void* fileData) {
   std::string magic = getFileFourcc(fileData);
   std::transform(magic.begin(), magic.end(), magic.begin(), [](unsigned char c){ return std::tolower(c); });
   return magic;
 }
+
+bool globMatch(std::string_view pattern, std::string_view str) {
+  size_t p = 0, s = 0;
+  size_t starP = std::string_view::npos, starS = 0;
+  while (s < str.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+      p++;
+      s++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      starP = p++;
+      starS = s;
+    } else if (starP != std::string_view::npos) {
+      // let the last * swallow one more character
+      p = starP + 1;
+      s = ++starS;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') p++;
+  return p == pattern.size();
+}
 }
\ No newline at end of file
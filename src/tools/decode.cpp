@@ -1,23 +1,75 @@
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 
 #include "rsnd/soundCommon.hpp"
 #include "rsnd/SoundWave.hpp"
 #include "rsnd/SoundStream.hpp"
 #include "rsnd/SoundSequence.hpp"
+#include "rsnd/LoopRenderer.hpp"
 #include "common/fileUtil.hpp"
+#include "common/threadPool.hpp"
 #include "tools/decode.hpp"
 #include "tools/common.hpp"
 #include "vgmtrans/MidiFile.h"
 
 namespace rsnd {
+// a huge --fade would overflow u32, clamp before converting
+static u32 fadeSamples(double fadeSeconds, u32 sampleRate) {
+  return static_cast<u32>(std::clamp<double>(fadeSeconds * sampleRate, 0, UINT32_MAX));
+}
+
+// writes the render chunk by chunk, so the file can be far larger than the memory used
+static void renderLoopedWave(LoopRenderer& renderer, u32 sampleRate, u32 chunkSamples, const std::filesystem::path& wavePath) {
+  WaveWriter writer(wavePath, sampleRate, renderer.getChannelCount(), renderer.getSampleCount());
+  if (!writer.isOpen()) return;
+  std::vector<s16> buffer(static_cast<size_t>(chunkSamples) * renderer.getChannelCount());
+  while (u32 samples = renderer.read(buffer.data(), chunkSamples)) {
+    writer.write(buffer.data(), samples);
+  }
+}
+
+static void warnNotLooped(const CliOpts& cliOpts, bool looped) {
+  if (!looped) std::cerr << "Warning: " << cliOpts.inputFile << " has no loop, decoding it once\n";
+}
+
 void rsndDecodeWave(const SoundWave& soundWave, CliOpts& cliOpts) {
   if (cliOpts.outputPath.empty()) {
     auto tmp = cliOpts.inputFile;
     tmp.replace_extension(".wav");
     cliOpts.outputPath = tmp;
   }
-  soundWave.toWaveFile(cliOpts.outputPath);
+  const DecodeOpts& decodeOpts = cliOpts.decodeOpts;
+  if (decodeOpts.loops == 0) {
+    soundWave.toWaveFile(cliOpts.outputPath);
+    return;
+  }
+
+  warnNotLooped(cliOpts, soundWave.isLooped());
+  u32 sampleRate = soundWave.info->getSampleRate();
+  LoopRenderer renderer(
+    [&](u32 startSample, u32 sampleCount, s16* buffer) { return soundWave.decodeRange(startSample, sampleCount, buffer); },
+    [&](u32 loopOffset, u32 sampleCount, s16* buffer) { return soundWave.decodeLoopRange(loopOffset, sampleCount, buffer); },
+    soundWave.getChannelCount(), soundWave.getTrackSampleCount(), soundWave.isLooped(),
+    soundWave.getLoopStart(), soundWave.getLoopEnd(), decodeOpts.loops, fadeSamples(decodeOpts.fadeSeconds, sampleRate));
+  // chunks of a few seek table entries per thread, like the stream blocks below
+  u32 chunkSamples = AdpcmSeekTable::DEFAULT_INTERVAL_FRAMES * AX_ADPCM_SAMPLES_PER_FRAME * 2 * getThreadPool().getThreadCount();
+  renderLoopedWave(renderer, sampleRate, chunkSamples, cliOpts.outputPath);
+}
+
+static void loopedTrackToWaveFile(const SoundStream& soundStream, u8 trackIdx, const DecodeOpts& decodeOpts, const std::filesystem::path& wavePath) {
+  u8 channelCount;
+  soundStream.getTrackChannels(trackIdx, channelCount);
+  if (!soundStream.checkFormat()) return;
+  u32 sampleRate = soundStream.strmDataInfo->getSampleRate();
+  LoopRenderer renderer(
+    [&](u32 startSample, u32 sampleCount, s16* buffer) { return soundStream.decodeRange(trackIdx, startSample, sampleCount, buffer); },
+    [&](u32 loopOffset, u32 sampleCount, s16* buffer) { return soundStream.decodeLoopRange(trackIdx, loopOffset, sampleCount, buffer); },
+    channelCount, soundStream.getSampleCount(), soundStream.isLooped(),
+    soundStream.getLoopStart(), soundStream.getLoopEnd(), decodeOpts.loops, fadeSamples(decodeOpts.fadeSeconds, sampleRate));
+  u32 chunkSamples = soundStream.getFullBlockSamples() * 2 * getThreadPool().getThreadCount();
+  renderLoopedWave(renderer, sampleRate, chunkSamples, wavePath);
 }
 
 void rsndDecodeStream(const SoundStream& soundStream, CliOpts& cliOpts) {
@@ -33,9 +85,14 @@ void rsndDecodeStream(const SoundStream& soundStream, CliOpts& cliOpts) {
   if (soundStream.trackTable->trackCount > 1) {
     std::filesystem::create_directories(cliOpts.outputPath);
   }
+  if (cliOpts.decodeOpts.loops > 0) warnNotLooped(cliOpts, soundStream.isLooped());
   for (int i = 0; i < soundStream.trackTable->trackCount; i++) {
     const std::filesystem::path outpath = soundStream.trackTable->trackCount > 1 ? cliOpts.outputPath / (std::to_string(i) + ".wav") : cliOpts.outputPath;
-    soundStream.trackToWaveFile(i, outpath);
+    if (cliOpts.decodeOpts.loops > 0) {
+      loopedTrackToWaveFile(soundStream, i, cliOpts.decodeOpts, outpath);
+    } else {
+      soundStream.trackToWaveFile(i, outpath);
+    }
   }
 }
 
@@ -50,8 +107,11 @@ void rsndDecodeSequence(const SoundSequence& soundSequence, CliOpts& cliOpts) {
 }
 
 void rsndDecode(CliOpts& cliOpts) {
-  size_t inputSize;
-  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+  MappedFile inputFile(cliOpts.inputFile);
+  rsndDecodeData(inputFile.data(), inputFile.size(), cliOpts);
+}
+
+void rsndDecodeData(const void* inputData, size_t inputSize, CliOpts& cliOpts) {
   FileFormat inputFormat = detectFileFormat(cliOpts.inputFile.filename().string(), inputData, inputSize);
   switch (inputFormat)
   {
@@ -74,7 +134,5 @@ void rsndDecode(CliOpts& cliOpts) {
     std::cerr << cliOpts.inputFile << " file format decode not supported\n";
     exit(-1);
   }
-
-  free(inputData);
 }
 }
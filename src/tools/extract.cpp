@@ -3,6 +3,14 @@
 #include <filesystem>
 #include <cstring>
 #include <algorithm>
+#include <cctype>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "rsnd/SoundArchive.hpp"
 #include "rsnd/SoundWaveArchive.hpp"
@@ -12,6 +20,8 @@
 #include "rsnd/soundCommon.hpp"
 #include "common/cli.h"
 #include "common/fileUtil.hpp"
+#include "common/threadPool.hpp"
+#include "common/waveCache.hpp"
 #include "tools/common.hpp"
 #include "tools/decode.hpp"
 
@@ -22,70 +32,201 @@
 using namespace rsnd;
 
 namespace rsnd {
-void rsndExtractRwar(const SoundWaveArchive& waveArchive, const CliOpts& cliOpts) {
+// decodes through the wave cache, so a wave shared by several group items or sounds is only decoded once
+static void cachedWaveToFile(const WaveCache::Key& key, u32 sampleCount, u8 channelCount, u32 sampleRate,
+                             const std::function<void(s16*)>& decode, const std::filesystem::path& wavPath) {
+  WaveCache::Pcm pcm = getWaveCache().get(key, static_cast<size_t>(sampleCount) * channelCount, decode);
+  createWaveFile(wavPath, pcm.get(), sampleCount, sampleRate, channelCount);
+}
+
+static void rwarWaveToFile(const void* archive, const SoundWaveArchive& waveArchive, u32 waveIdx, const std::filesystem::path& wavPath) {
+  size_t rwavSize;
+  const void* rwavData = waveArchive.getWaveFile(waveIdx, rwavSize);
+  SoundWave rwav(rwavData, rwavSize);
+  cachedWaveToFile(WaveCache::Key::make(archive, waveArchive.dataBase, waveIdx), rwav.getTrackSampleCount(), rwav.getChannelCount(),
+                   rwav.info->getSampleRate(), [&](s16* buffer) { rwav.decodeTrack(buffer); }, wavPath);
+}
+
+static void rwsdWaveToFile(const void* archive, const SoundWsd& soundWsd, u32 waveIdx, const void* waveData, const std::filesystem::path& wavPath) {
+  const WaveInfo* waveInfo = soundWsd.getWaveInfo(waveIdx);
+  cachedWaveToFile(WaveCache::Key::make(archive, waveData, waveIdx), waveInfo->getLoopEnd(), waveInfo->channelCount,
+                   waveInfo->getSampleRate(), [&](s16* buffer) { soundWsd.decodeWave(waveIdx, waveData, buffer); }, wavPath);
+}
+
+// archive is the file the RWAR lies in, it keys the wave cache
+void rsndExtractRwar(const SoundWaveArchive& waveArchive, const void* archive, const CliOpts& cliOpts) {
   auto contentsDir = cliOpts.outputPath;
 
   const int waveCount = waveArchive.getWaveCount();
-  for (int i = 0; i < waveCount; i++) {
+  getThreadPool().parallelFor(waveCount, [&](size_t i) {
     size_t size;
-    void* waveData = waveArchive.getWaveFile(i, size);
+    const void* waveData = waveArchive.getWaveFile(i, size);
     if (size > 0) {
       auto magic = magicLowercase(waveData);
       auto wavPath = contentsDir / (std::to_string(i) + ".b" + magic);
       writeBinary(wavPath, waveData, size);
 
-      if (cliOpts.extractOpts.decode) {
+      if (cliOpts.extractOpts.decode && cliOpts.decodeOpts.loops == 0 && detectFileFormat("", waveData, size) == FMT_BRWAV) {
+        rwarWaveToFile(archive, waveArchive, i, std::filesystem::path(wavPath).replace_extension(".wav"));
+      } else if (cliOpts.extractOpts.decode) {
         CliOpts decodeOpts = cliOpts;
         decodeOpts.inputFile = wavPath;
         decodeOpts.outputPath = ""; // auto-figure out path from input
-        rsndDecode(decodeOpts);
+        // the wave is already in memory, no need to read back the file just written
+        rsndDecodeData(waveData, size, decodeOpts);
       }
     }
-  }
+  });
 }
 
-void extract_brsar_sounds(const SoundArchive& soundArchive, const CliOpts& cliOpts) {
-  auto contentsDir = cliOpts.outputPath;
-
-  const SoundTable* soundTable = soundArchive.soundTable;
-  for (int i = 0; i < soundTable->size; i++) {
-    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(i);
-    // TODO
-  }
-}
-
-void extract_rbnk_sf2(const std::filesystem::path filepath, void* fileData, size_t fileSize, void* waveData, size_t waveSize) {
-  SoundBank soundBank(fileData, fileSize, waveData);
-  std::vector<WaveAudio> waveAudios;
+void extract_rbnk_sf2(const std::filesystem::path filepath, const void* archive, const void* fileData, size_t fileSize, const void* waveData, size_t waveSize) {
+  SoundBank soundBank(fileData, fileSize);
+  WaveCollection waveCollection;
   if (soundBank.containsWaves) {
-    waveAudios = std::move(toWaveCollection(&soundBank, waveData));
+    waveCollection = toWaveCollection(&soundBank, waveData, archive);
   } else {
     SoundWaveArchive waveArchive(waveData, waveSize);
-    for (int i = 0; i < waveArchive.getWaveCount(); i++) {
-      size_t rwavSize;
-      void* rwavData = waveArchive.getWaveFile(i, rwavSize);
-      SoundWave rwav(rwavData, rwavSize);
-      waveAudios.push_back(toWaveAudio(&rwav));
-    }
+    waveCollection = toWaveCollection(&waveArchive, archive);
   }
 
-  SF2File sf2file(&soundBank, waveAudios);
+  SF2File sf2file(&soundBank, waveCollection.waves);
   sf2file.SaveSF2File(filepath);
 }
 
-void extract_rwsd_embedded_wav(const std::filesystem::path filepath, const SoundWsd& soundWsd, void* waveData, size_t waveSize) {
+void extract_rwsd_embedded_wav(const std::filesystem::path filepath, const void* archive, const SoundWsd& soundWsd, const void* waveData, size_t waveSize) {
   std::filesystem::create_directories(filepath);
 
   for (int i = 0; i < soundWsd.getWaveInfoCount(); i++) {
-    soundWsd.trackToWaveFile(i, waveData, filepath / (std::to_string(i) + ".wav"));
+    rwsdWaveToFile(archive, soundWsd, i, waveData, filepath / (std::to_string(i) + ".wav"));
+  }
+}
+
+// sound ids matched by --only/--manifest filters. A filter is a sound id, a glob or an exact sound name
+std::set<u32> resolveSoundFilters(const SoundArchive& soundArchive, const std::vector<std::string>& soundFilters, bool warn = true) {
+  std::set<u32> soundIds;
+  const u32 soundCount = soundArchive.getSoundCount();
+  for (const std::string& filter : soundFilters) {
+    bool found = false;
+    if (std::all_of(filter.begin(), filter.end(), [](unsigned char c) { return std::isdigit(c); })) {
+      unsigned long id = std::strtoul(filter.c_str(), nullptr, 10);
+      if (id < soundCount) {
+        soundIds.insert(id);
+        found = true;
+      }
+    } else if (filter.find_first_of("*?") != std::string::npos) {
+      for (u32 i = 0; i < soundCount; i++) {
+        const char* name = soundArchive.getString(soundArchive.getSoundInfo(i)->fileNameIdx);
+        if (name && globMatch(filter, name)) {
+          soundIds.insert(i);
+          found = true;
+        }
+      }
+    } else {
+      s32 id = soundArchive.findSoundId(filter);
+      if (id >= 0) {
+        soundIds.insert(id);
+        found = true;
+      }
+    }
+    if (!found && warn) std::cerr << "Warning: no sound matches " << filter << '\n';
+  }
+  return soundIds;
+}
+
+// group items (group index -> item indices) holding the files the given sounds need
+std::map<u32, std::set<u32>> resolveSoundGroupItems(const SoundArchive& soundArchive, const std::set<u32>& soundIds) {
+  std::set<u32> fileIds;
+  for (u32 soundId : soundIds) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(soundId);
+    fileIds.insert(soundInfo->fileIdx);
+    // sequences also need their bank (and through it, the bank's wave archive)
+    if (soundInfo->soundType == SoundInfoEntry::TYPE_SEQ) {
+      const SeqSoundInfo* seqSoundInfo = soundArchive.getSeqSoundInfo(soundInfo);
+      fileIds.insert(soundArchive.getBankInfo(seqSoundInfo->bankIdx)->fileIdx);
+    }
+  }
+
+  std::map<u32, std::set<u32>> groupItems;
+  for (u32 fileId : fileIds) {
+    const FileGroupInfo* fileGroupInfo = soundArchive.getFileGroupInfo(fileId);
+    if (!fileGroupInfo) continue;
+    for (u32 i = 0; i < fileGroupInfo->size; i++) {
+      const FileGroup* fileGroup = soundArchive.getFileGroup(fileId, i);
+      groupItems[fileGroup->groupIdx].insert(fileGroup->idx);
+    }
+  }
+  return groupItems;
+}
+
+void extract_brsar_group_item(const SoundArchive& soundArchive, u32 groupIdx, u32 itemIdx, const std::filesystem::path& subGroupPath, const CliOpts& cliOpts) {
+  const GroupInfo* groupInfo = soundArchive.getGroupInfo(groupIdx);
+  const GroupItemInfo* groupItemInfo = soundArchive.getGroupItemInfo(groupIdx, itemIdx);
+  std::filesystem::create_directories(subGroupPath);
+
+  size_t fileSize;
+  const void* fileData = soundArchive.getInternalFileData(groupInfo, groupItemInfo, &fileSize);
+  // write main file data
+  FileFormat fileFormat = detectFileFormat("", fileData, fileSize);
+  if (fileSize > 0) {
+    auto magic = magicLowercase(fileData);
+    writeBinary(subGroupPath / ("file.b" + magic), fileData, fileSize);
+  }
+
+  size_t waveSize;
+  const void* waveData = soundArchive.getInternalWaveData(groupInfo, groupItemInfo, &waveSize);
+
+  // write sf2 file for RBNK
+  if (fileFormat == FMT_BRBNK && cliOpts.extractOpts.decode && !cliOpts.extractOpts.rsarExtractOpts.mergedSf2) {
+    extract_rbnk_sf2(subGroupPath / "soundfont.sf2", soundArchive.getData(), fileData, fileSize, waveData, waveSize);
+  }
+
+  // for RWSD files in the old RSAR format, extract any embedded wave files
+  if (fileFormat == FMT_BRWSD && cliOpts.extractOpts.decode && detectFileFormat("", waveData, waveSize) != FMT_BRWAR && waveSize > 0) {
+    SoundWsd soundWsd(fileData, fileSize);
+    extract_rwsd_embedded_wav(subGroupPath / "wave", soundArchive.getData(), soundWsd, waveData, waveSize);
+  }
+
+  // convert RSEQ files during extraction if asked for
+  if (fileFormat == FMT_BRSEQ && cliOpts.extractOpts.decode) {
+    SoundSequence soundSequence(fileData, fileSize);
+    MidiFile midiFile(&soundSequence);
+    midiFile.SaveMidiFile(subGroupPath / "file.mid");
+  }
+
+  // write wave data
+  if (waveSize > 0 && detectFileFormat("", waveData, waveSize) == FMT_BRWAR) {
+    auto magic = magicLowercase(waveData);
+    std::filesystem::path wavePath = subGroupPath / ("wave.b" + magic);
+    writeBinary(wavePath, waveData, waveSize);
+
+    if (cliOpts.extractOpts.rsarExtractOpts.extractRwars) {
+      CliOpts waveOpts = cliOpts;
+      waveOpts.outputPath = wavePath.string() + ".d";
+      if (fileFormat == FMT_BRBNK) waveOpts.extractOpts.decode = false; // rwav samples would be already decoded to sf2
+      std::filesystem::create_directories(waveOpts.outputPath);
+      SoundWaveArchive waveArchive(waveData, waveSize);
+      rsndExtractRwar(waveArchive, soundArchive.getData(), waveOpts);
+    }
   }
 }
 
 void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOpts) {
   auto contentsDir = cliOpts.outputPath;
 
-  GroupTable* groupTable = soundArchive.groupTable;
+  const auto& soundFilters = cliOpts.extractOpts.rsarExtractOpts.soundFilters;
+  const bool filtered = !soundFilters.empty();
+  std::map<u32, std::set<u32>> selectedItems;
+  if (filtered) selectedItems = resolveSoundGroupItems(soundArchive, resolveSoundFilters(soundArchive, soundFilters));
+
+  // items are independent, except that groups sharing a name (e.g. anonymous ones) also share
+  // item directories. Those items stay in one job, in archive order, so the result matches a serial run
+  std::vector<std::filesystem::path> itemPaths;
+  std::vector<std::vector<std::pair<u32, u32>>> itemJobs;
+  std::map<std::filesystem::path, size_t> jobByPath;
+
+  const GroupTable* groupTable = soundArchive.getGroupTable();
   for (int i = 0; i < groupTable->size; i++) {
+    if (filtered && !selectedItems.contains(i)) continue;
     const GroupInfo* groupInfo = soundArchive.getGroupInfo(i);
     const char* name = soundArchive.getString(groupInfo->nameIdx);
     if (!name) name = "_anonymous_group_";
@@ -96,58 +237,318 @@ void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOp
 
     const int groupSize = soundArchive.getGroupSize(groupInfo);
     for (int j = 0; j < groupSize; j++) {
-      const GroupItemInfo* groupItemInfo = soundArchive.getGroupItemInfo(i, j);
-    
+      if (filtered && !selectedItems[i].contains(j)) continue;
       std::filesystem::path subGroupPath = groupPath / std::to_string(j);
-      std::filesystem::create_directories(subGroupPath);
+      auto [job, inserted] = jobByPath.try_emplace(subGroupPath, itemJobs.size());
+      if (inserted) {
+        itemPaths.push_back(subGroupPath);
+        itemJobs.emplace_back();
+      }
+      itemJobs[job->second].emplace_back(i, j);
+    }
+  }
+
+  getThreadPool().parallelFor(itemJobs.size(), [&](size_t job) {
+    for (auto [groupIdx, itemIdx] : itemJobs[job]) {
+      extract_brsar_group_item(soundArchive, groupIdx, itemIdx, itemPaths[job], cliOpts);
+    }
+  });
+}
+
+// decode an extracted file next to it, the output path is derived from the input. The data is still in memory, no need to read the file back
+void decodeExtractedFile(const std::filesystem::path& filePath, const void* fileData, size_t fileSize, const CliOpts& cliOpts) {
+  CliOpts decodeOpts = cliOpts;
+  decodeOpts.inputFile = filePath;
+  decodeOpts.outputPath = ""; // auto-figure out path from input
+  rsndDecodeData(fileData, fileSize, decodeOpts);
+}
 
+// write a bank and its wave archive to the banks directory, plus the sf2 when decoding
+void extract_brsar_bank(const SoundArchive& soundArchive, u32 bankIdx, const std::filesystem::path& banksDir, const CliOpts& cliOpts) {
+  const BankInfo* bankInfo = soundArchive.getBankInfo(bankIdx);
+  const char* name = soundArchive.getString(bankInfo->fileNameIdx);
+  std::string bankName = name ? name : "_anonymous_bank_" + std::to_string(bankIdx);
+
+  size_t fileSize, waveSize = 0;
+  const void* fileData = soundArchive.getInternalFileData(bankInfo->fileIdx, &fileSize);
+  const void* waveData = soundArchive.getInternalWaveData(bankInfo->fileIdx, &waveSize);
+  if (!fileData || fileSize == 0) {
+    std::cerr << "Warning: bank " << bankName << " is not stored in the archive\n";
+    return;
+  }
+
+  std::filesystem::create_directories(banksDir);
+  writeBinary(banksDir / (bankName + ".b" + magicLowercase(fileData)), fileData, fileSize);
+  if (waveSize > 0 && detectFileFormat("", waveData, waveSize) == FMT_BRWAR) {
+    writeBinary(banksDir / (bankName + ".brwar"), waveData, waveSize);
+  }
+
+  if (cliOpts.extractOpts.decode && !cliOpts.extractOpts.rsarExtractOpts.mergedSf2) {
+    extract_rbnk_sf2(banksDir / (bankName + ".sf2"), soundArchive.getData(), fileData, fileSize, waveData, waveSize);
+  }
+}
+
+// a WSD with its waves, parsed once for all the wave sounds stored in it
+struct SharedWsd {
+  SoundWsd soundWsd;
+  const void* waveData;
+  size_t waveSize;
+  std::optional<SoundWaveArchive> waveArchive;
+
+  SharedWsd(const void* fileData, size_t fileSize, const void* waveData, size_t waveSize)
+    : soundWsd(fileData, fileSize), waveData(waveData), waveSize(waveSize) {
+    if (waveSize > 0 && detectFileFormat("", waveData, waveSize) == FMT_BRWAR) waveArchive.emplace(waveData, waveSize);
+  }
+};
+
+void extract_brsar_wave_sound(const SoundArchive& soundArchive, const SoundInfoEntry* soundInfo, const SharedWsd& sharedWsd, const std::string& soundName, const CliOpts& cliOpts) {
+  auto contentsDir = cliOpts.outputPath;
+  if (sharedWsd.waveSize == 0) return;
+
+  const SoundWsd& soundWsd = sharedWsd.soundWsd;
+  const std::optional<SoundWaveArchive>& waveArchive = sharedWsd.waveArchive;
+  const Wsd* wsd = soundWsd.getWsd(soundArchive.getWsdSoundInfo(soundInfo)->idx);
+  const s32 waveCount = waveArchive ? waveArchive->getWaveCount() : soundWsd.getWaveInfoCount();
+
+  // one wave per distinct note, the first one takes the sound's name
+  std::vector<s32> waveIdxs;
+  for (u32 i = 0; i < soundWsd.getNoteCount(wsd); i++) {
+    s32 waveIdx = soundWsd.getNoteInfo(wsd, i)->waveIdx;
+    if (waveIdx < 0 || waveIdx >= waveCount) {
+      std::cerr << "Warning: note " << i << " of sound " << soundName << " references missing wave " << waveIdx << '\n';
+      continue;
+    }
+    if (std::find(waveIdxs.begin(), waveIdxs.end(), waveIdx) != waveIdxs.end()) continue;
+    waveIdxs.push_back(waveIdx);
+
+    std::string suffix = waveIdxs.size() > 1 ? "_" + std::to_string(waveIdxs.size() - 1) : "";
+    std::filesystem::path wavPath = contentsDir / (soundName + suffix + ".wav");
+    if (waveArchive) {
+      rwarWaveToFile(soundArchive.getData(), *waveArchive, waveIdx, wavPath);
+    } else {
+      rwsdWaveToFile(soundArchive.getData(), soundWsd, waveIdx, sharedWsd.waveData, wavPath);
+    }
+  }
+}
+
+void extract_brsar_stream_sound(const SoundArchive& soundArchive, const SoundInfoEntry* soundInfo, const std::string& soundName, const CliOpts& cliOpts) {
+  std::filesystem::path strmPath = cliOpts.outputPath / (soundName + ".brstm");
+  if (soundArchive.isFileExternal(soundInfo->fileIdx)) {
+    // external paths are relative to the archive
+    std::filesystem::path externalPath = cliOpts.inputFile.parent_path() / soundArchive.getFileExternalPath(soundInfo->fileIdx);
+    if (!std::filesystem::exists(externalPath)) {
+      std::cerr << "Warning: stream file " << externalPath << " of sound " << soundName << " not found\n";
+      return;
+    }
+    std::filesystem::copy_file(externalPath, strmPath, std::filesystem::copy_options::overwrite_existing);
+    if (cliOpts.extractOpts.decode) {
+      MappedFile externalFile(externalPath);
+      decodeExtractedFile(strmPath, externalFile.data(), externalFile.size(), cliOpts);
+    }
+  } else {
+    size_t fileSize;
+    const void* fileData = soundArchive.getInternalFileData(soundInfo->fileIdx, &fileSize);
+    writeBinary(strmPath, fileData, fileSize);
+    if (cliOpts.extractOpts.decode) decodeExtractedFile(strmPath, fileData, fileSize, cliOpts);
+  }
+}
+
+// every sound's decoded output is written under its own name. Sequence and WSD files hold several sounds and banks are
+// shared between sequences, so they are extracted once into files/ and banks/
+void extract_brsar_sounds(const SoundArchive& soundArchive, const CliOpts& cliOpts) {
+  auto contentsDir = cliOpts.outputPath;
+  const std::filesystem::path filesDir = contentsDir / "files";
+  std::set<u32> extractedFiles;
+  std::map<u32, std::unique_ptr<SoundSequence>> sequences;
+  std::map<u32, std::unique_ptr<SharedWsd>> wsds;
+  auto writeSharedFile = [&](u32 fileIdx, const void* fileData, size_t fileSize) {
+    if (!extractedFiles.insert(fileIdx).second) return;
+    std::filesystem::create_directories(filesDir);
+    writeBinary(filesDir / (std::to_string(fileIdx) + ".b" + magicLowercase(fileData)), fileData, fileSize);
+  };
+
+  const auto& soundFilters = cliOpts.extractOpts.rsarExtractOpts.soundFilters;
+  std::set<u32> soundIds;
+  if (soundFilters.empty()) {
+    for (u32 i = 0; i < soundArchive.getSoundCount(); i++) soundIds.insert(i);
+  } else {
+    soundIds = resolveSoundFilters(soundArchive, soundFilters);
+  }
+
+  std::set<u32> extractedBanks;
+  for (u32 i : soundIds) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(i);
+    const char* name = soundArchive.getString(soundInfo->fileNameIdx);
+    std::string soundName = name ? name : "_anonymous_sound_" + std::to_string(i);
+
+    if (soundInfo->soundType != SoundInfoEntry::TYPE_STRM && !soundArchive.getInternalFileData(soundInfo->fileIdx)) {
+      std::cerr << "Warning: sound " << soundName << " is not stored in the archive\n";
+      continue;
+    }
+
+    switch (soundInfo->soundType)
+    {
+    case SoundInfoEntry::TYPE_SEQ: {
       size_t fileSize;
-      void* fileData = soundArchive.getInternalFileData(groupInfo, groupItemInfo, &fileSize);
-      // write main file data
-      FileFormat fileFormat = detectFileFormat("", fileData, fileSize);
-      if (fileSize > 0) {
-        auto magic = magicLowercase(fileData);
-        writeBinary(subGroupPath / ("file.b" + magic), fileData, fileSize);
+      const void* fileData = soundArchive.getInternalFileData(soundInfo->fileIdx, &fileSize);
+      writeSharedFile(soundInfo->fileIdx, fileData, fileSize);
+      if (cliOpts.extractOpts.decode) {
+        std::unique_ptr<SoundSequence>& soundSequence = sequences[soundInfo->fileIdx];
+        if (!soundSequence) soundSequence = std::make_unique<SoundSequence>(fileData, fileSize);
+        // the sound starts at its own offset, other sounds of the file start elsewhere
+        u32 startOffset = soundArchive.getSeqSoundInfo(soundInfo)->offset;
+        if (startOffset >= soundSequence->seqData->length - soundSequence->seqData->offset) {
+          std::cerr << "Warning: sound " << soundName << " starts past the end of its sequence data\n";
+        } else {
+          MidiFile midiFile(soundSequence.get(), startOffset);
+          midiFile.SaveMidiFile(contentsDir / (soundName + ".mid"));
+        }
       }
 
-      size_t waveSize;
-      void* waveData = soundArchive.getInternalWaveData(groupInfo, groupItemInfo, &waveSize);
-
-      // write sf2 file for RBNK
-      if (fileFormat == FMT_BRBNK && cliOpts.extractOpts.decode) {
-        extract_rbnk_sf2(subGroupPath / "soundfont.sf2", fileData, fileSize, waveData, waveSize);
+      u32 bankIdx = soundArchive.getSeqSoundInfo(soundInfo)->bankIdx;
+      if (extractedBanks.insert(bankIdx).second) {
+        extract_brsar_bank(soundArchive, bankIdx, contentsDir / "banks", cliOpts);
       }
+      break;
+
+    } case SoundInfoEntry::TYPE_STRM:
+      extract_brsar_stream_sound(soundArchive, soundInfo, soundName, cliOpts);
+      break;
 
-      // for RWSD files in the old RSAR format, extract any embedded wave files
-      if (fileFormat == FMT_BRWSD && cliOpts.extractOpts.decode && detectFileFormat("", waveData, waveSize) != FMT_BRWAR && waveSize > 0) {
-        SoundWsd soundWsd(fileData, fileSize, waveData);
-        extract_rwsd_embedded_wav(subGroupPath / "wave", soundWsd, waveData, waveSize);
+    case SoundInfoEntry::TYPE_WAVE: {
+      size_t fileSize, waveSize = 0;
+      const void* fileData = soundArchive.getInternalFileData(soundInfo->fileIdx, &fileSize);
+      writeSharedFile(soundInfo->fileIdx, fileData, fileSize);
+      if (!cliOpts.extractOpts.decode) break;
+
+      std::unique_ptr<SharedWsd>& sharedWsd = wsds[soundInfo->fileIdx];
+      if (!sharedWsd) {
+        const void* waveData = soundArchive.getInternalWaveData(soundInfo->fileIdx, &waveSize);
+        sharedWsd = std::make_unique<SharedWsd>(fileData, fileSize, waveData, waveSize);
       }
+      extract_brsar_wave_sound(soundArchive, soundInfo, *sharedWsd, soundName, cliOpts);
+      break;
+
+    } default:
+      std::cerr << "Warning: unknown sound type " << (int)soundInfo->soundType << " for sound " << soundName << '\n';
+      break;
+    }
+  }
+}
+
+static size_t hashSample(const WaveAudio& wave) {
+  size_t hash = std::hash<std::string_view>()(std::string_view(static_cast<const char*>(wave.data), wave.dataLength));
+  for (int field : {wave.sampleRate, wave.loop, wave.loopStart, wave.loopEnd}) hash = hash * 31 + std::hash<int>()(field);
+  return hash;
+}
+
+static bool sameSample(const WaveAudio& a, const WaveAudio& b) {
+  return a.dataLength == b.dataLength && a.sampleRate == b.sampleRate && a.loop == b.loop &&
+         a.loopStart == b.loopStart && a.loopEnd == b.loopEnd && memcmp(a.data, b.data, a.dataLength) == 0;
+}
+
+// one SF2 for the given banks. Every bank keeps its index as SF2 bank number, identical samples are stored
+// once, and wave data shared by several banks is decoded once
+void extract_brsar_merged_sf2(const SoundArchive& soundArchive, const std::set<u32>& bankIdxs, const std::filesystem::path& filepath) {
+  std::vector<std::unique_ptr<SoundBank>> soundBanks;
+  // decoded waves by bank file (only for waves embedded in it) and wave data
+  std::map<std::pair<const void*, const void*>, WaveCollection> collections;
+  std::vector<SF2Bank> sf2Banks;
+  // views of the collections' PCM, one per distinct sample
+  std::vector<WaveAudio> samples;
+  std::unordered_multimap<size_t, u32> samplesByHash;
+  SF2File::TableSizes tableSizes;
+
+  for (u32 bankIdx : bankIdxs) {
+    const BankInfo* bankInfo = soundArchive.getBankInfo(bankIdx);
+    const char* name = soundArchive.getString(bankInfo->fileNameIdx);
+    std::string bankName = name ? name : "_anonymous_bank_" + std::to_string(bankIdx);
+
+    size_t fileSize, waveSize = 0;
+    const void* fileData = soundArchive.getInternalFileData(bankInfo->fileIdx, &fileSize);
+    const void* waveData = soundArchive.getInternalWaveData(bankInfo->fileIdx, &waveSize);
+    if (!fileData || fileSize == 0) {
+      std::cerr << "Warning: bank " << bankName << " is not stored in the archive, it is left out of the merged SoundFont\n";
+      continue;
+    }
+    if (bankIdx > 127) {
+      std::cerr << "Warning: bank " << bankName << " is SF2 bank " << bankIdx << ", past the 127 most players support\n";
+    }
 
-      // convert RSEQ files during extraction if asked for
-      if (fileFormat == FMT_BRSEQ && cliOpts.extractOpts.decode) {
-        SoundSequence soundSequence(fileData, fileSize);
-        MidiFile midiFile(&soundSequence);
-        midiFile.SaveMidiFile(subGroupPath / "file.mid");
+    soundBanks.push_back(std::make_unique<SoundBank>(fileData, fileSize));
+    const SoundBank& soundBank = *soundBanks.back();
+    // refused before decoding the rest
+    tableSizes.add(soundBank);
+    if (!tableSizes.fits()) {
+      std::cerr << "Warning: up to bank " << bankName << " the banks have " << tableSizes.presets << " presets with "
+                << tableSizes.zones << " zones and " << tableSizes.generators << " generators, more than the "
+                << SF2File::MAX_TABLE_INDEX << " an SF2 can index. The merged SoundFont is not written, extract without --merged-sf2 for one per bank\n";
+      return;
+    }
+    auto collectionKey = std::make_pair(soundBank.containsWaves ? fileData : nullptr, waveData);
+    auto collection = collections.find(collectionKey);
+    if (collection == collections.end()) {
+      WaveCollection waveCollection;
+      if (soundBank.containsWaves) {
+        waveCollection = toWaveCollection(&soundBank, waveData, soundArchive.getData());
+      } else {
+        SoundWaveArchive waveArchive(waveData, waveSize);
+        waveCollection = toWaveCollection(&waveArchive, soundArchive.getData());
       }
+      collection = collections.emplace(collectionKey, std::move(waveCollection)).first;
+    }
 
-      // write wave data
-      if (waveSize > 0 && detectFileFormat("", waveData, waveSize) == FMT_BRWAR) {
-        auto magic = magicLowercase(waveData);
-        std::filesystem::path wavePath = subGroupPath / ("wave.b" + magic);
-        writeBinary(wavePath, waveData, waveSize);
-
-        if (cliOpts.extractOpts.rsarExtractOpts.extractRwars) {
-          CliOpts waveOpts = cliOpts;
-          waveOpts.outputPath = wavePath.string() + ".d";
-          if (fileFormat == FMT_BRBNK) waveOpts.extractOpts.decode = false; // rwav samples would be already decoded to sf2
-          std::filesystem::create_directories(waveOpts.outputPath);
-          SoundWaveArchive waveArchive(waveData, waveSize);
-          rsndExtractRwar(waveArchive, waveOpts);
+    SF2Bank sf2Bank{&soundBank, static_cast<u16>(bankIdx), "b" + std::to_string(bankIdx) + "_", {}};
+    for (const WaveAudio& wave : collection->second.waves) {
+      size_t hash = hashSample(wave);
+      u32 sampleId = samples.size();
+      auto [first, last] = samplesByHash.equal_range(hash);
+      for (auto it = first; it != last; ++it) {
+        if (sameSample(samples[it->second], wave)) {
+          sampleId = it->second;
+          break;
         }
       }
+      if (sampleId == samples.size()) {
+        WaveAudio sample;
+        sample.sampleRate = wave.sampleRate;
+        sample.loop = wave.loop;
+        sample.loopStart = wave.loopStart;
+        sample.loopEnd = wave.loopEnd;
+        sample.data = wave.data;
+        sample.dataLength = wave.dataLength;
+        sample.ownsData = false;
+        samples.push_back(std::move(sample));
+        samplesByHash.emplace(hash, sampleId);
+      }
+      sf2Bank.sampleIds.push_back(sampleId);
     }
+    sf2Banks.push_back(std::move(sf2Bank));
+  }
+  if (sf2Banks.empty()) return;
+  if (samples.size() > SF2File::MAX_SAMPLES) {
+    std::cerr << "Warning: " << samples.size() << " distinct samples, more than the " << SF2File::MAX_SAMPLES
+              << " an SF2 can refer to. The merged SoundFont is not written, extract without --merged-sf2 for one per bank\n";
+    return;
   }
+
+  SF2File sf2file("RSND archive", sf2Banks, samples);
+  sf2file.SaveSF2File(filepath);
+}
+
+// banks of the merged SoundFont: all of them, or the banks of the sequences the filters select
+std::set<u32> resolveMergedBanks(const SoundArchive& soundArchive, const std::vector<std::string>& soundFilters) {
+  std::set<u32> bankIdxs;
+  if (soundFilters.empty()) {
+    for (u32 i = 0; i < soundArchive.getBankCount(); i++) bankIdxs.insert(i);
+    return bankIdxs;
+  }
+  // the extraction itself already warned about filters without a match
+  for (u32 soundId : resolveSoundFilters(soundArchive, soundFilters, false)) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(soundId);
+    if (soundInfo->soundType == SoundInfoEntry::TYPE_SEQ) bankIdxs.insert(soundArchive.getSeqSoundInfo(soundInfo)->bankIdx);
+  }
+  return bankIdxs;
 }
 
 void rsndExtractRsar(const SoundArchive& soundArchive, const CliOpts cliOpts) {
@@ -157,18 +558,28 @@ void rsndExtractRsar(const SoundArchive& soundArchive, const CliOpts cliOpts) {
     extract_brsar_groups(soundArchive, cliOpts);
     break;
   
+  case EXTRACT_SOUNDS:
+    extract_brsar_sounds(soundArchive, cliOpts);
+    break;
+
   default:
     std::cerr << "Unknown extraction style " << cliOpts.extractOpts.rsarExtractOpts.extractStyle << '\n';
     exit(-1);
     break;
   }
+
+  const RsarExtractOpts& rsarExtractOpts = cliOpts.extractOpts.rsarExtractOpts;
+  if (cliOpts.extractOpts.decode && rsarExtractOpts.mergedSf2) {
+    extract_brsar_merged_sf2(soundArchive, resolveMergedBanks(soundArchive, rsarExtractOpts.soundFilters), cliOpts.outputPath / "soundfont.sf2");
+  }
 }
 
 void rsndExtract(const CliOpts& cliOpts) {
   std::filesystem::create_directories(cliOpts.outputPath);
 
-  size_t inputSize;
-  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+  MappedFile inputFile(cliOpts.inputFile);
+  const void* inputData = inputFile.data();
+  size_t inputSize = inputFile.size();
   FileFormat inputFormat = detectFileFormat(cliOpts.inputFile.filename().string(), inputData, inputSize);
   switch (inputFormat)
   {
@@ -179,14 +590,14 @@ void rsndExtract(const CliOpts& cliOpts) {
 
   } case FMT_BRWAR: {
     SoundWaveArchive waveArchive(inputData, inputSize);
-    rsndExtractRwar(waveArchive, cliOpts);
+    rsndExtractRwar(waveArchive, inputData, cliOpts);
     break;
 
   } default:
     std::cerr << cliOpts.inputFile << " file format extraction not supported\n";
     exit(-1);
   }
-
-  free(inputData);
+  // the cache is keyed by addresses in the input file
+  getWaveCache().clear();
 }
 }
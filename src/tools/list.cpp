@@ -34,7 +34,7 @@ void rsndListFileInfo(const SoundArchive& soundArchive, int fileIdx) {
 }
 
 void rsndListRsarGroups(const SoundArchive& soundArchive, CliOpts& cliOpts) {
-  GroupTable* groupTable = soundArchive.groupTable;
+  const GroupTable* groupTable = soundArchive.getGroupTable();
   for (int i = 0; i < groupTable->size; i++) {
     const GroupInfo* groupInfo = soundArchive.getGroupInfo(i);
     const char* name = soundArchive.getString(groupInfo->nameIdx);
@@ -47,7 +47,7 @@ void rsndListRsarGroups(const SoundArchive& soundArchive, CliOpts& cliOpts) {
 }
 
 void rsndListRsarBanks(const SoundArchive& soundArchive, CliOpts& cliOpts) {
-  BankTable* bankTable = soundArchive.bankTable;
+  const BankTable* bankTable = soundArchive.getBankTable();
   for (int i = 0; i < bankTable->size; i++) {
     const BankInfo* bankInfo = soundArchive.getBankInfo(i);
     const char* name = soundArchive.getString(bankInfo->fileNameIdx);
@@ -81,7 +81,7 @@ std::string rwsdShortDesc(const SoundArchive& SoundArchive, const WsdSoundInfo*
 }
 
 void rsndListRsarSounds(const SoundArchive& soundArchive, CliOpts& cliOpts) {
-  SoundTable* soundTable = soundArchive.soundTable;
+  const SoundTable* soundTable = soundArchive.getSoundTable();
   for (int i = 0; i < soundTable->size; i++) {
     const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(i);
     const char* name = soundArchive.getString(soundInfo->fileNameIdx);
@@ -134,31 +134,31 @@ void rsndListRsar(const SoundArchive& soundArchive, CliOpts& cliOpts) {
   }
 }
 
-void printSubregionRecurse(const SoundBank& soundBank, DataRef* ref, int depth) {
+void printSubregionRecurse(const SoundBank& soundBank, const DataRef* ref, int depth) {
   switch (ref->dataType) {
   case REGIONSET_DIRECT: {
     for (int i = 0; i < depth; i++) std::cout << "    ";
-    InstrInfo* instrInfo = ref->getAddr<InstrInfo>(soundBank.dataBase);
+    const InstrInfo* instrInfo = ref->getAddr<InstrInfo>(soundBank.dataBase);
     std::cout << "sample #: " << std::to_string(instrInfo->waveIdx) << '\n';
     break;
   
   } case REGIONSET_RANGE: {
-    RangeTable* rangeTable = ref->getAddr<RangeTable>(soundBank.dataBase);
+    const RangeTable* rangeTable = ref->getAddr<RangeTable>(soundBank.dataBase);
     for (int i = 0; i < rangeTable->rangeCount; i++) {
       for (int i = 0; i < depth; i++) std::cout << "    ";
       std::cout << "range: up to " << (int)rangeTable->key[i] << '\n';
-      DataRef* dataRef = const_cast<SoundBank&>(soundBank).getSubregionRef(ref, rangeTable->key[i]);
+      const DataRef* dataRef = soundBank.getSubregionRef(ref, rangeTable->key[i]);
       printSubregionRecurse(soundBank, dataRef, depth + 1);
     }
     
     break;
 
   } case REGIONSET_INDEX: {
-    IndexRegion* indexRegion = ref->getAddr<IndexRegion>(soundBank.dataBase);
+    const IndexRegion* indexRegion = ref->getAddr<IndexRegion>(soundBank.dataBase);
     for (int i = indexRegion->min; i < indexRegion->max; i++) {
       for (int i = 0; i < depth; i++) std::cout << "    ";
       std::cout << "index " << std::to_string(i) << '\n';
-      printSubregionRecurse(soundBank, const_cast<SoundBank&>(soundBank).getSubregionRef(ref, i), depth + 1);
+      printSubregionRecurse(soundBank, soundBank.getSubregionRef(ref, i), depth + 1);
     }
   
     break;
@@ -243,8 +243,9 @@ void rsndListRwsd(const SoundWsd& soundWsd, CliOpts& cliOpts) {
 }
 
 void rsndList(CliOpts& cliOpts) {
-  size_t inputSize;
-  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+  MappedFile inputFile(cliOpts.inputFile);
+  const void* inputData = inputFile.data();
+  size_t inputSize = inputFile.size();
   FileFormat inputFormat = detectFileFormat(cliOpts.inputFile.filename().string(), inputData, inputSize);
   switch (inputFormat)
   {
@@ -287,7 +288,5 @@ void rsndList(CliOpts& cliOpts) {
     std::cerr << cliOpts.inputFile << " file format list not supported\n";
     exit(-1);
   }
-
-  free(inputData);
 }
 }
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "rsnd/SoundArchive.hpp"
+#include "rsnd/SoundBank.hpp"
+#include "rsnd/SoundSequence.hpp"
+#include "rsnd/SoundWsd.hpp"
+#include "testCommon.hpp"
+#include "vgmtrans/MidiFile.h"
+#include "vgmtrans/SF2File.h"
+#include "vgmtrans/WaveAudio.h"
+
+using namespace rsnd;
+
+// every range of a bank or WSD wave has to match the same samples of a plain full decode
+template<typename T>
+static void checkWaveRanges(const T& file, const void* waveData) {
+  for (int i = 0; i < file.getWaveInfoCount(); i++) {
+    const WaveInfo* waveInfo = file.getWaveInfo(i);
+    const u32 channelCount = waveInfo->channelCount;
+    const u32 sampleCount = waveInfo->getLoopEnd();
+    std::vector<ChannelData> channels = getWaveChannels(waveInfo, waveData);
+    std::vector<s16> full(static_cast<size_t>(sampleCount) * channelCount);
+    decodeInterleaved(waveInfo->format, channels.data(), channelCount, sampleCount, full.data(), channelCount);
+
+    CHECK(file.getWaveSeekTable(i, waveData) == file.getWaveSeekTable(i, waveData));
+    const u32 ranges[][2] = { { 0, sampleCount }, { sampleCount / 3, sampleCount / 2 }, { 15, 14 }, { sampleCount - 5, 100 } };
+    for (const auto& [start, count] : ranges) {
+      std::vector<s16> range(static_cast<size_t>(count) * channelCount);
+      u32 written = file.decodeWaveRange(i, waveData, start, count, range.data());
+      CHECK(written == std::min(count, sampleCount - start));
+      CHECK(std::equal(range.begin(), range.begin() + static_cast<size_t>(written) * channelCount, full.begin() + static_cast<size_t>(start) * channelCount));
+    }
+  }
+}
+
+static std::vector<uint8_t> sequenceMidi(const SoundSequence& soundSequence, u32 startOffset) {
+  std::vector<uint8_t> midi;
+  MidiFile(&soundSequence, startOffset).WriteMidiToBuffer(midi);
+  return midi;
+}
+
+// sounds sharing an RSEQ start at their own offsets, each has to convert from there
+static void testSequenceOffsets(const SoundArchive& soundArchive) {
+  const SoundInfoEntry* first = soundArchive.getSoundInfo(soundArchive.findSoundId("SE_SEQ_A"));
+  const SoundInfoEntry* second = soundArchive.getSoundInfo(soundArchive.findSoundId("SE_SEQ_B"));
+  CHECK(first->fileIdx == second->fileIdx);
+  u32 secondOffset = soundArchive.getSeqSoundInfo(second)->offset;
+  CHECK(secondOffset != 0);
+
+  size_t fileSize;
+  const void* fileData = soundArchive.getInternalFileData(first->fileIdx, &fileSize);
+  SoundSequence soundSequence(fileData, fileSize);
+  CHECK(soundSequence.getLabelOffset(soundSequence.getSeqLabel(1)) == secondOffset);
+  std::vector<uint8_t> firstMidi = sequenceMidi(soundSequence, soundArchive.getSeqSoundInfo(first)->offset);
+  CHECK(firstMidi == sequenceMidi(soundSequence, 0));
+  CHECK(firstMidi != sequenceMidi(soundSequence, secondOffset));
+}
+
+template<typename T>
+static void storeBe(be<T>& field, T value) {
+  typename be<T>::Storage raw = std::bit_cast<typename be<T>::Storage>(value);
+  if constexpr (std::endian::native == std::endian::little && sizeof(T) > 1) raw = std::byteswap(raw);
+  field.raw = raw;
+}
+
+// a malformed SYMB tree whose children lead back to the root must end the lookup instead of looping
+static void testCyclicTree(std::vector<char> data) {
+  SoundArchive soundArchive(data.data(), data.size());
+  StringTree* tree = const_cast<StringTree*>(soundArchive.getGroupStringTree());
+  StringTreeNode& root = tree->nodes.elems[tree->rootIdx];
+  storeBe<u16>(root.flags, 0);
+  storeBe<u32>(root.leftIdx, tree->rootIdx);
+  storeBe<u32>(root.rightIdx, tree->rootIdx);
+  CHECK(soundArchive.findGroupId("GROUP_MAIN") == -1);
+}
+
+// the flattened lookup behind getInstrInfo/resolve has to agree with the region lists for every note
+static void testRegionLookup(const SoundBank& soundBank) {
+  std::vector<NoteQuery> queries;
+  std::vector<const InstrInfo*> expected;
+  // one program past the end, which resolves to nothing
+  for (u32 program = 0; program <= soundBank.getInstrCount(); program++) {
+    std::vector<SoundBank::InstrumentRegion> regions;
+    if (program < soundBank.getInstrCount()) regions = soundBank.getInstrRegions(program);
+    for (u8 key = 0; key < 128; key++) {
+      for (u8 velocity = 0; velocity < 128; velocity++) {
+        auto region = std::find_if(regions.begin(), regions.end(), [&](const SoundBank::InstrumentRegion& r) {
+          return r.keyLo <= key && key <= r.keyHi && r.velLo <= velocity && velocity <= r.velHi;
+        });
+        const InstrInfo* instrInfo = region != regions.end() ? region->instrInfo : nullptr;
+        CHECK(soundBank.getInstrInfo(program, key, velocity) == instrInfo);
+        queries.push_back({ program, key, velocity, nullptr });
+        expected.push_back(instrInfo);
+      }
+    }
+  }
+  soundBank.resolve(queries);
+  CHECK(std::equal(queries.begin(), queries.end(), expected.begin(), [](const NoteQuery& query, const InstrInfo* instrInfo) {
+    return query.instrInfo == instrInfo;
+  }));
+}
+
+// records of a pdta sub-chunk of an SF2 in memory
+template<typename T>
+static std::vector<T> sf2Records(const std::vector<uint8_t>& sf2, const char* tag) {
+  auto read32 = [&](size_t offset) { u32 value; memcpy(&value, sf2.data() + offset, 4); return value; };
+  for (size_t pos = 12; pos + 12 <= sf2.size(); pos += 8 + read32(pos + 4)) {
+    if (memcmp(sf2.data() + pos, "LIST", 4) != 0 || memcmp(sf2.data() + pos + 8, "pdta", 4) != 0) continue;
+    const size_t end = pos + 8 + read32(pos + 4);
+    for (size_t sub = pos + 12; sub + 8 <= end; sub += 8 + read32(sub + 4)) {
+      if (memcmp(sf2.data() + sub, tag, 4) != 0) continue;
+      std::vector<T> records(read32(sub + 4) / sizeof(T));
+      memcpy(records.data(), sf2.data() + sub + 8, records.size() * sizeof(T));
+      return records;
+    }
+  }
+  return {};
+}
+
+// as many copies of a bank as the 16 bit SF2 table indices allow, like a merge of a whole archive.
+// Every index has to land on its own table's records, one more copy has to be refused rather than wrap
+static void testMergedSf2(const SoundBank& soundBank, const void* waveData, const void* archive) {
+  SF2File::TableSizes bankSizes;
+  bankSizes.add(soundBank);
+  CHECK(bankSizes.generators > 0);
+  const size_t copies = SF2File::MAX_TABLE_INDEX / bankSizes.generators;
+
+  WaveCollection collection = toWaveCollection(&soundBank, waveData, archive);
+  std::vector<SF2Bank> banks;
+  SF2File::TableSizes tableSizes;
+  for (size_t i = 0; i < copies; i++) {
+    std::vector<uint32_t> sampleIds(collection.waves.size());
+    for (size_t j = 0; j < sampleIds.size(); j++) sampleIds[j] = j;
+    banks.push_back({ &soundBank, static_cast<uint16_t>(i), "b" + std::to_string(i) + "_", sampleIds });
+    tableSizes.add(soundBank);
+  }
+  CHECK(tableSizes.fits());
+  SF2File::TableSizes over = tableSizes;
+  over.add(soundBank);
+  CHECK(!over.fits() && over.generators > SF2File::MAX_TABLE_INDEX);
+
+  std::vector<uint8_t> sf2 = SF2File("test", banks, collection.waves).SaveToMem();
+  std::vector<sfPresetHeader> phdr = sf2Records<sfPresetHeader>(sf2, "phdr");
+  std::vector<sfInst> inst = sf2Records<sfInst>(sf2, "inst");
+  std::vector<sfInstBag> ibag = sf2Records<sfInstBag>(sf2, "ibag");
+  std::vector<sfInstGenList> igen = sf2Records<sfInstGenList>(sf2, "igen");
+  CHECK(phdr.size() == tableSizes.presets + 1 && inst.size() == tableSizes.presets + 1);
+  CHECK(ibag.size() == tableSizes.zones + 1 && igen.size() == tableSizes.generators + 1);
+  CHECK(sf2Records<sfPresetBag>(sf2, "pbag").size() == tableSizes.presets + 1);
+  if (inst.empty() || ibag.empty() || igen.empty()) return;
+  CHECK(inst.back().wInstBagNdx == ibag.size() - 1 && ibag.back().wInstGenNdx == igen.size() - 1);
+
+  // zones start with their key range and end with their sample
+  bool zonesAligned = true;
+  for (size_t i = 0; i + 1 < ibag.size(); i++) {
+    const uint16_t first = ibag[i].wInstGenNdx, next = ibag[i + 1].wInstGenNdx;
+    zonesAligned &= first < next && next < igen.size() && igen[first].sfGenOper == keyRange && igen[next - 1].sfGenOper == sampleID;
+  }
+  CHECK(zonesAligned);
+  bool instrsAligned = true;
+  for (size_t i = 0; i + 1 < inst.size(); i++) instrsAligned &= inst[i].wInstBagNdx <= inst[i + 1].wInstBagNdx;
+  CHECK(instrsAligned);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <brsar>\n";
+    return 1;
+  }
+  std::ifstream file(argv[1], std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to open " << argv[1] << '\n';
+    return 1;
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  SoundArchive soundArchive(data.data(), data.size());
+  CHECK(soundArchive.getParsedTableCount() == 0);
+
+  // walking the groups must only resolve the group table
+  CHECK(soundArchive.getGroupCount() == 3);
+  for (u32 i = 0; i < soundArchive.getGroupCount(); i++) {
+    const GroupInfo* groupInfo = soundArchive.getGroupInfo(i);
+    for (int j = 0; j < soundArchive.getGroupSize(groupInfo); j++) soundArchive.getGroupItemInfo(i, j);
+  }
+  CHECK(soundArchive.getParsedTableCount() == 1);
+
+  // name lookups add the group tree and the string table, once
+  CHECK(soundArchive.findGroupId("GROUP_SHARE") == 2);
+  CHECK(soundArchive.findGroupId("GROUP_MAIN") == 0);
+  CHECK(soundArchive.getParsedTableCount() == 3);
+
+  // BANK_EMB and the old WSD carry their wave infos, their samples are in the file's wave data
+  const BankInfo* bankInfo = soundArchive.getBankInfo(soundArchive.findBankId("BANK_EMB"));
+  size_t fileSize;
+  const void* fileData = soundArchive.getInternalFileData(bankInfo->fileIdx, &fileSize);
+  SoundBank soundBank(fileData, fileSize);
+  CHECK(soundBank.containsWaves);
+  checkWaveRanges(soundBank, soundArchive.getInternalWaveData(bankInfo->fileIdx));
+  testRegionLookup(soundBank);
+  testMergedSf2(soundBank, soundArchive.getInternalWaveData(bankInfo->fileIdx), soundArchive.getData());
+  bankInfo = soundArchive.getBankInfo(soundArchive.findBankId("BANK_EXT"));
+  fileData = soundArchive.getInternalFileData(bankInfo->fileIdx, &fileSize);
+  testRegionLookup(SoundBank(fileData, fileSize));
+
+  const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(soundArchive.findSoundId("SE_OLD_0"));
+  fileData = soundArchive.getInternalFileData(soundInfo->fileIdx, &fileSize);
+  SoundWsd soundWsd(fileData, fileSize);
+  CHECK(soundWsd.containsWaveInfo);
+  checkWaveRanges(soundWsd, soundArchive.getInternalWaveData(soundInfo->fileIdx));
+
+  testSequenceOffsets(soundArchive);
+  testCyclicTree(data);
+
+  if (testFailures) return 1;
+  std::cout << "archiveTest: ok\n";
+  return 0;
+}
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "common/fileUtil.hpp"
+#include "common/waveCache.hpp"
+#include "rsnd/AdpcmSeekTable.hpp"
+#include "rsnd/LoopRenderer.hpp"
+#include "rsnd/decodeSimd.hpp"
+#include "rsnd/soundCommon.hpp"
+#include "testCommon.hpp"
+
+using namespace rsnd;
+
+static std::mt19937 rng(0x6d727374);
+
+static void fillRandom(u8* data, size_t size) {
+  std::uniform_int_distribution<int> byte(0, 0xff);
+  for (size_t i = 0; i < size; i++) data[i] = byte(rng);
+}
+
+// random headers include predictors past 7, both decoders clamp the coefficient index
+static void testAdpcmBlockRef() {
+  std::uniform_int_distribution<u32> frameCount(0, 40);
+  std::uniform_int_distribution<u32> tail(0, AX_ADPCM_SAMPLES_PER_FRAME - 1);
+  std::uniform_int_distribution<int> history(-32768, 32767);
+
+  for (u32 stride = 1; stride <= 0xff; stride++) {
+    for (int iter = 0; iter < 4; iter++) {
+      // every other run ends in a partial frame
+      const u32 sampleCount = frameCount(rng) * AX_ADPCM_SAMPLES_PER_FRAME + (iter & 1 ? tail(rng) : 0);
+      std::vector<u8> data((sampleCount + AX_ADPCM_SAMPLES_PER_FRAME - 1) / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE);
+      fillRandom(data.data(), data.size());
+      be<s16> coeffs[16];
+      fillRandom(reinterpret_cast<u8*>(coeffs), sizeof(coeffs));
+      const s16 yn1 = history(rng);
+      const s16 yn2 = history(rng);
+
+      // samples between the strided ones must stay untouched as well
+      std::vector<s16> expected(sampleCount * stride, 0x5555);
+      std::vector<s16> actual(expected);
+      decodeAdpcmBlockRef(data.data(), sampleCount, coeffs, yn1, yn2, expected.data(), stride);
+      decodeAdpcmBlock(data.data(), sampleCount, coeffs, yn1, yn2, actual.data(), stride);
+      if (!expected.empty() && memcmp(expected.data(), actual.data(), expected.size() * sizeof(s16)) != 0) {
+        std::cerr << "decodeAdpcmBlock differs from the reference: stride " << stride << ", " << sampleCount << " samples\n";
+        testFailures++;
+      }
+    }
+  }
+}
+
+static std::vector<s16> decodeAt(SimdLevel level, u8 format, const ChannelData* channels, u32 channelCount, u32 sampleCount, u32 stride) {
+  setSimdLevel(level);
+  std::vector<s16> buffer(sampleCount * stride, 0x5555);
+  if (format == WaveInfo::FORMAT_ADPCM) {
+    decodeAdpcmChannels(channels, channelCount, sampleCount, buffer.data(), stride);
+  } else {
+    decodePcmChannels(channels, channelCount, sampleCount, buffer.data(), stride, format);
+  }
+  return buffer;
+}
+
+// each SIMD level has to match the scalar kernels byte for byte, levels the CPU lacks are skipped
+static void testSimdKernels() {
+  const SimdLevel supported = detectSimdLevel();
+  std::uniform_int_distribution<int> history(-32768, 32767);
+  const u32 sampleCounts[] = { 1, 7, 13, 14, 15, 17, 31, 33, 14 * 9 + 5, 1001 };
+
+  for (SimdLevel level : { SIMD_SSE41, SIMD_AVX2 }) {
+    if (level > supported) {
+      std::cout << "decodeTest: skipping " << getSimdLevelName(level) << ", not supported by this CPU\n";
+      continue;
+    }
+    for (u8 format : { WaveInfo::FORMAT_PCM8, WaveInfo::FORMAT_PCM16, WaveInfo::FORMAT_ADPCM }) {
+      for (u32 channelCount = 1; channelCount <= 8; channelCount++) {
+        for (u32 sampleCount : sampleCounts) {
+          // separate allocations per channel so a kernel reading past its channel's end shows up under ASan
+          std::vector<std::vector<u8>> data(channelCount);
+          std::vector<ChannelData> channels(channelCount);
+          be<s16> coeffs[16];
+          fillRandom(reinterpret_cast<u8*>(coeffs), sizeof(coeffs));
+          for (u32 c = 0; c < channelCount; c++) {
+            size_t size = format == WaveInfo::FORMAT_PCM8 ? sampleCount :
+                          format == WaveInfo::FORMAT_PCM16 ? sampleCount * 2 :
+                          (sampleCount + AX_ADPCM_SAMPLES_PER_FRAME - 1) / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE;
+            data[c].resize(size);
+            fillRandom(data[c].data(), size);
+            channels[c] = { data[c].data(), coeffs, static_cast<s16>(history(rng)), static_cast<s16>(history(rng)) };
+          }
+
+          // interleaved as the decoders write it, and into a wider frame as the stream reader does
+          for (u32 stride : { channelCount, channelCount + 3 }) {
+            std::vector<s16> expected = decodeAt(SIMD_SCALAR, format, channels.data(), channelCount, sampleCount, stride);
+            std::vector<s16> actual = decodeAt(level, format, channels.data(), channelCount, sampleCount, stride);
+            if (memcmp(expected.data(), actual.data(), expected.size() * sizeof(s16)) != 0) {
+              std::cerr << getSimdLevelName(level) << " differs from scalar: format " << (int)format << ", " << channelCount
+                        << " channels, " << sampleCount << " samples, stride " << stride << '\n';
+              testFailures++;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// ranges decoded through seek tables of a few intervals have to match a full decode
+static void testAdpcmSeekTable() {
+  std::uniform_int_distribution<int> history(-32768, 32767);
+  std::uniform_int_distribution<u32> position(0, 5000);
+  for (u32 channelCount = 1; channelCount <= 6; channelCount++) {
+    const u32 sampleCount = 4000 + channelCount * 97;
+    std::vector<std::vector<u8>> data(channelCount);
+    std::vector<ChannelData> channels(channelCount);
+    be<s16> coeffs[16];
+    fillRandom(reinterpret_cast<u8*>(coeffs), sizeof(coeffs));
+    for (u32 c = 0; c < channelCount; c++) {
+      data[c].resize((sampleCount + AX_ADPCM_SAMPLES_PER_FRAME - 1) / AX_ADPCM_SAMPLES_PER_FRAME * AX_ADPCM_FRAME_SIZE);
+      fillRandom(data[c].data(), data[c].size());
+      channels[c] = { data[c].data(), coeffs, static_cast<s16>(history(rng)), static_cast<s16>(history(rng)) };
+    }
+    std::vector<s16> full(static_cast<size_t>(sampleCount) * channelCount);
+    decodeInterleaved(WaveInfo::FORMAT_ADPCM, channels.data(), channelCount, sampleCount, full.data(), channelCount);
+
+    for (u32 intervalFrames : { 1u, 3u, 1024u }) {
+      AdpcmSeekTable table(channels.data(), channelCount, sampleCount, intervalFrames);
+      for (int iter = 0; iter < 20; iter++) {
+        const u32 start = position(rng);
+        const u32 count = position(rng);
+        std::vector<s16> range(static_cast<size_t>(count) * channelCount);
+        const u32 written = table.decodeRange(channels.data(), start, count, range.data());
+        CHECK(written == (start < sampleCount ? std::min(count, sampleCount - start) : 0));
+        if (written && memcmp(range.data(), full.data() + static_cast<size_t>(start) * channelCount, static_cast<size_t>(written) * channelCount * sizeof(s16)) != 0) {
+          std::cerr << "seek table range differs: " << channelCount << " channels, interval " << intervalFrames << ", " << start << '+' << count << '\n';
+          testFailures++;
+        }
+      }
+    }
+  }
+}
+
+// a synthetic source whose loop decoder differs from the linear one, so every sample shows which decoder
+// it came from. The render must be the same for any chunk size
+static void testLoopRenderer() {
+  const u8 channelCount = 2;
+  const u32 sourceSamples = 3000, loopStart = 700, loopEnd = 2500, loopCount = 3, fadeSamples = 500;
+  auto linearSample = [](u32 pos, u8 c) { return static_cast<s16>(pos * 2 + c); };
+  auto loopSample = [](u32 loopOffset, u8 c) { return static_cast<s16>(-1 - static_cast<s32>(loopOffset * 2 + c)); };
+  auto decodeRange = [&](u32 startSample, u32 sampleCount, s16* buffer) {
+    if (startSample >= sourceSamples) return 0u;
+    sampleCount = std::min(sampleCount, sourceSamples - startSample);
+    for (u32 i = 0; i < sampleCount; i++) {
+      for (u8 c = 0; c < channelCount; c++) buffer[i * channelCount + c] = linearSample(startSample + i, c);
+    }
+    return sampleCount;
+  };
+  auto decodeLoop = [&](u32 loopOffset, u32 sampleCount, s16* buffer) {
+    for (u32 i = 0; i < sampleCount; i++) {
+      for (u8 c = 0; c < channelCount; c++) buffer[i * channelCount + c] = loopSample(loopOffset + i, c);
+    }
+    return sampleCount;
+  };
+
+  // intro and first pass linear, the repeats from the loop decoder, then the fade keeps looping
+  const u64 fadeStart = loopEnd + static_cast<u64>(loopCount - 1) * (loopEnd - loopStart);
+  const u64 totalSamples = fadeStart + fadeSamples;
+  std::vector<s16> expected(totalSamples * channelCount);
+  for (u64 p = 0; p < totalSamples; p++) {
+    for (u8 c = 0; c < channelCount; c++) {
+      s64 sample = p < loopEnd ? linearSample(p, c) : loopSample((p - loopStart) % (loopEnd - loopStart), c);
+      if (p >= fadeStart) sample = sample * static_cast<s64>(totalSamples - p) / fadeSamples;
+      expected[p * channelCount + c] = static_cast<s16>(sample);
+    }
+  }
+
+  for (u32 chunkSamples : { 1u, 13u, 1800u, 100000u }) {
+    LoopRenderer renderer(decodeRange, decodeLoop, channelCount, sourceSamples, true, loopStart, loopEnd, loopCount, fadeSamples);
+    CHECK(renderer.getSampleCount() == totalSamples);
+    std::vector<s16> actual;
+    std::vector<s16> chunk(static_cast<size_t>(chunkSamples) * channelCount);
+    while (u32 samples = renderer.read(chunk.data(), chunkSamples)) {
+      actual.insert(actual.end(), chunk.begin(), chunk.begin() + static_cast<size_t>(samples) * channelCount);
+    }
+    CHECK(renderer.isDone());
+    if (actual != expected) {
+      std::cerr << "loop render differs with " << chunkSamples << " sample chunks\n";
+      testFailures++;
+    }
+  }
+
+  // without a loop the source plays once, untouched
+  LoopRenderer once(decodeRange, decodeLoop, channelCount, sourceSamples, false, loopStart, loopEnd, loopCount, fadeSamples);
+  CHECK(once.getSampleCount() == sourceSamples);
+  std::vector<s16> actual(static_cast<size_t>(sourceSamples) * channelCount);
+  CHECK(once.read(actual.data(), sourceSamples) == sourceSamples);
+  bool linear = true;
+  for (u32 i = 0; i < sourceSamples * channelCount; i++) linear &= actual[i] == linearSample(i / channelCount, i % channelCount);
+  CHECK(linear);
+}
+
+template<typename T>
+static T readLe(const std::vector<char>& data, size_t offset) {
+  T value;
+  memcpy(&value, data.data() + offset, sizeof(T));
+  return value;
+}
+
+static bool hasTag(const std::vector<char>& data, size_t offset, const char* tag) {
+  return offset + 4 <= data.size() && memcmp(data.data() + offset, tag, 4) == 0;
+}
+
+static std::vector<char> writeWave(const std::filesystem::path& path, u64 expectedSamples, const std::vector<s16>& pcm, u16 numChannels) {
+  {
+    WaveWriter writer(path, 32000, numChannels, expectedSamples);
+    writer.write(pcm.data(), pcm.size() / numChannels);
+  }
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  std::filesystem::remove(path);
+  return data;
+}
+
+// RIFF headers as closed, and the RF64 header that close writes over the JUNK chunk past 4 GiB.
+// Writing that much data is too slow for a test, the RF64 header is checked on its own
+static void testWaveWriter() {
+  const u16 numChannels = 2;
+  std::vector<s16> pcm(200);
+  for (size_t i = 0; i < pcm.size(); i++) pcm[i] = static_cast<s16>(i * 331);
+  const u32 dataSize = pcm.size() * sizeof(s16);
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "mrst_decodeTest.wav";
+
+  // a known small length needs no reserve
+  std::vector<char> riff = writeWave(path, pcm.size() / numChannels, pcm, numChannels);
+  CHECK(riff.size() == WaveWriter::RIFF_HEADER_SIZE + dataSize);
+  CHECK(hasTag(riff, 0, "RIFF") && readLe<u32>(riff, 4) == riff.size() - 8 && hasTag(riff, 8, "WAVE"));
+  CHECK(hasTag(riff, 12, "fmt ") && readLe<u16>(riff, 22) == numChannels && readLe<u32>(riff, 24) == 32000);
+  CHECK(hasTag(riff, 36, "data") && readLe<u32>(riff, 40) == dataSize);
+  CHECK(memcmp(riff.data() + WaveWriter::RIFF_HEADER_SIZE, pcm.data(), dataSize) == 0);
+
+  // an unknown length reserves a JUNK chunk for ds64, readers skip it
+  std::vector<char> reserved = writeWave(path, WaveWriter::UNKNOWN_LENGTH, pcm, numChannels);
+  const size_t fmtOffset = 12 + WaveWriter::RF64_RESERVE_SIZE;
+  const size_t headerSize = WaveWriter::RIFF_HEADER_SIZE + WaveWriter::RF64_RESERVE_SIZE;
+  CHECK(reserved.size() == headerSize + dataSize);
+  CHECK(hasTag(reserved, 0, "RIFF") && readLe<u32>(reserved, 4) == reserved.size() - 8);
+  CHECK(hasTag(reserved, 12, "JUNK") && readLe<u32>(reserved, 16) == WaveWriter::RF64_RESERVE_SIZE - 8);
+  CHECK(hasTag(reserved, fmtOffset, "fmt ") && hasTag(reserved, headerSize - 8, "data") && readLe<u32>(reserved, headerSize - 4) == dataSize);
+  CHECK(memcmp(reserved.data() + fmtOffset, riff.data() + 12, WaveWriter::RIFF_HEADER_SIZE - 12 - 4) == 0);
+
+  // RF64 over that layout: ds64 ends right where fmt starts, and its sizes describe the whole file
+  const u64 numSamples = 0x50000001;
+  std::vector<char> rf64(reserved.begin(), reserved.begin() + headerSize);
+  WaveWriter::putRf64Header(rf64.data(), numSamples, numChannels);
+  const u64 rf64DataSize = numSamples * numChannels * sizeof(s16);
+  CHECK(WaveWriter::RF64_HEADER_SIZE == fmtOffset);
+  CHECK(hasTag(rf64, 0, "RF64") && readLe<u32>(rf64, 4) == UINT32_MAX && hasTag(rf64, 8, "WAVE"));
+  CHECK(hasTag(rf64, 12, "ds64") && 20 + readLe<u32>(rf64, 16) == fmtOffset);
+  CHECK(readLe<u64>(rf64, 20) == headerSize + rf64DataSize - 8);
+  CHECK(readLe<u64>(rf64, 28) == rf64DataSize);
+  CHECK(readLe<u64>(rf64, 36) == numSamples);
+  CHECK(readLe<u32>(rf64, 44) == 0);
+  CHECK(hasTag(rf64, fmtOffset, "fmt "));
+}
+
+static WaveCache::Pcm makePcm(size_t sampleCount, s16 value) {
+  std::shared_ptr<s16> pcm(new s16[sampleCount], std::default_delete<s16[]>());
+  std::fill(pcm.get(), pcm.get() + sampleCount, value);
+  return pcm;
+}
+
+// least recently used entries go first once the budget is exceeded, held PCM outlives its entry
+static void testWaveCache() {
+  const u8 archive[64] = {};
+  auto key = [&](u32 waveIdx) { return WaveCache::Key::make(archive, archive + 32, waveIdx); };
+  WaveCache cache(100 * sizeof(s16));
+
+  cache.insert(key(0), makePcm(40, 0), 40);
+  cache.insert(key(1), makePcm(40, 1), 40);
+  CHECK(cache.find(key(0), 40) != nullptr);
+  CHECK(cache.find(key(0), 41) == nullptr);
+  CHECK(cache.find(WaveCache::Key::make(archive, archive, 0), 40) == nullptr);
+  CHECK(cache.find(key(WaveCache::ALL_WAVES), 40) == nullptr);
+  WaveCache::Pcm held = cache.find(key(1), 40);
+  cache.find(key(0), 40);
+
+  // 120 samples: wave 1 is the least recently used
+  cache.insert(key(2), makePcm(40, 2), 40);
+  CHECK(cache.find(key(1), 40) == nullptr);
+  CHECK(cache.find(key(0), 40) != nullptr && cache.find(key(2), 40) != nullptr);
+  CHECK(held && held.get()[0] == 1 && held.get()[39] == 1);
+
+  // replacing an entry gives its old size back
+  cache.insert(key(0), makePcm(20, 3), 20);
+  cache.insert(key(3), makePcm(40, 4), 40);
+  CHECK(cache.find(key(0), 20) != nullptr && cache.find(key(2), 40) != nullptr && cache.find(key(3), 40) != nullptr);
+
+  // larger than the whole budget is never stored
+  cache.insert(key(4), makePcm(101, 5), 101);
+  CHECK(cache.find(key(4), 101) == nullptr);
+  CHECK(cache.find(key(0), 20) != nullptr);
+
+  // get decodes on a miss only
+  int decodes = 0;
+  auto decode = [&](s16* buffer) { decodes++; std::fill(buffer, buffer + 10, 7); };
+  WaveCache::Pcm got = cache.get(key(5), 10, decode);
+  CHECK(cache.get(key(5), 10, decode) == got);
+  CHECK(decodes == 1 && got.get()[9] == 7);
+
+  cache.setBudget(30 * sizeof(s16));
+  CHECK(cache.find(key(5), 10) != nullptr && cache.find(key(0), 20) != nullptr);
+  CHECK(cache.find(key(2), 40) == nullptr && cache.find(key(3), 40) == nullptr);
+
+  // no budget, no cache
+  cache.setBudget(0);
+  CHECK(cache.find(key(5), 10) == nullptr);
+  cache.get(key(5), 10, decode);
+  cache.get(key(5), 10, decode);
+  CHECK(decodes == 3);
+
+  cache.setBudget(100 * sizeof(s16));
+  cache.insert(key(0), makePcm(40, 0), 40);
+  cache.clear();
+  CHECK(cache.find(key(0), 40) == nullptr);
+}
+
+int main() {
+  testAdpcmBlockRef();
+  testSimdKernels();
+  testAdpcmSeekTable();
+  testLoopRenderer();
+  testWaveWriter();
+  testWaveCache();
+
+  if (testFailures) return 1;
+  std::cout << "decodeTest: ok\n";
+  return 0;
+}
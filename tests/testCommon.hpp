@@ -0,0 +1,14 @@
+#pragma once
+
+#include <iostream>
+
+// failed checks are counted and reported, the test keeps running so one run shows every mismatch
+inline int testFailures = 0;
+
+#define CHECK(cond)                                                               \
+  do {                                                                            \
+    if (!(cond)) {                                                                \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond "\n"; \
+      testFailures++;                                                             \
+    }                                                                             \
+  } while (0)